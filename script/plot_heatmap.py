@@ -0,0 +1,38 @@
+#!/usr/bin/env python3
+import argparse
+import csv
+
+import matplotlib.pyplot as plt
+import numpy as np
+
+
+def load(path, column):
+    with open(path, newline="") as f:
+        rows = [r for r in csv.DictReader(f) if r[column] != ""]
+    nx = max(int(r["x"]) for r in rows) + 1
+    ny = max(int(r["y"]) for r in rows) + 1
+    grid = np.full((ny, nx), np.nan)
+    for r in rows:
+        grid[int(r["y"]), int(r["x"])] = float(r[column])
+    extent = [
+        min(float(r["llx"]) for r in rows),
+        max(float(r["urx"]) for r in rows),
+        min(float(r["lly"]) for r in rows),
+        max(float(r["ury"]) for r in rows),
+    ]
+    return grid, extent
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("path", help="path to the <tuple>_heatmap.csv file")
+    parser.add_argument(
+        "-c", "--column", help="column to plot", default="delta_delay_mean"
+    )
+    args = parser.parse_args()
+    grid, extent = load(args.path, args.column)
+    plt.imshow(grid, origin="lower", extent=extent, cmap="coolwarm")
+    plt.colorbar(label=args.column)
+    plt.title(args.column)
+    plt.tight_layout()
+    plt.show()
@@ -16,6 +16,47 @@ bool analyser::parse_configs() {
     return false;
   }
   collect_from_node("output_dir", _output_dir);
+  collect_from_node("scope", _scopes);
+  // region: [llx, lly, urx, ury] or a list of them
+  if (const auto &region = _configs["region"]; region && region.size() > 0) {
+    try {
+      if (region[0].IsSequence()) {
+        for (const auto &win : region) {
+          _regions.push_back(win.as<spatial_grid::window>());
+        }
+      } else {
+        _regions.push_back(region.as<spatial_grid::window>());
+      }
+    } catch (const std::exception &err) {
+      fmt::print("region should be [llx, lly, urx, ury], {}\n", err.what());
+      return false;
+    }
+    for (auto &win : _regions) {
+      win = {std::min(win[0], win[2]), std::min(win[1], win[3]),
+             std::max(win[0], win[2]), std::max(win[1], win[3])};
+    }
+  }
+  // heatmap: {bins: [nx, ny], die: [llx, lly, urx, ury], percentiles: [...]}
+  if (const auto &map = _configs["heatmap"]; map) {
+    try {
+      if (map["bins"].IsScalar()) {
+        _heatmap_bins.fill(map["bins"].as<int>());
+      } else {
+        _heatmap_bins = map["bins"].as<std::array<int, 2>>();
+      }
+      if (map["die"]) {
+        auto die = map["die"].as<spatial_grid::window>();
+        _heatmap_die = {std::min(die[0], die[2]), std::min(die[1], die[3]),
+                        std::max(die[0], die[2]), std::max(die[1], die[3])};
+      }
+      if (map["percentiles"]) {
+        _heatmap_percentiles = map["percentiles"].as<std::vector<double>>();
+      }
+    } catch (const std::exception &err) {
+      fmt::print("heatmap should be {{bins: [nx, ny]}}, {}\n", err.what());
+      return false;
+    }
+  }
   if (!_configs["analyse_tuples"]) {
     fmt::print("analyse_tuples is not defined in configs\n");
     return false;
@@ -101,6 +142,20 @@ absl::flat_hash_set<std::string> analyser::check_valid(YAML::Node &rpts) {
   return valid_rpts;
 }
 
+std::vector<std::pair<std::string, std::string>> analyser::semi_join_pairs()
+    const {
+  std::vector<std::pair<std::string, std::string>> pairs;
+  if (!_semi_join) {
+    return pairs;
+  }
+  for (const auto &rpt_tuple : _analyse_tuples) {
+    if (rpt_tuple.size() == 2) {
+      pairs.emplace_back(rpt_tuple[0], rpt_tuple[1]);
+    }
+  }
+  return pairs;
+}
+
 bool analyser::check_file_exists(std::string &file_path) {
   if (!std::filesystem::exists(file_path)) {
     fmt::print(fmt::fg(fmt::color::red), "File {} does not exist\n", file_path);
@@ -108,3 +163,117 @@ bool analyser::check_file_exists(std::string &file_path) {
   }
   return true;
 }
+
+void analyser::prepare_scopes() {
+  if (_scopes.empty()) {
+    return;
+  }
+  for (const auto &[_, db] : _dbs) {
+    if (db == nullptr) {
+      continue;
+    }
+    if (db->hierarchy.empty()) {
+      db->build_hierarchy();
+    }
+    auto &nodes = _scope_nodes[db.get()];
+    nodes.clear();
+    for (const auto &scope : _scopes) {
+      int node = db->hierarchy.find(scope);
+      if (node < 0) {
+        fmt::print(fmt::fg(fmt::color::yellow),
+                   "Scope {} not found in {} db\n", scope, db->type);
+        continue;
+      }
+      nodes.push_back(node);
+    }
+  }
+}
+
+bool analyser::in_scope(const std::shared_ptr<basedb> &db,
+                        std::string_view pin_name) const {
+  if (_scopes.empty()) {
+    return true;
+  }
+  auto it = _scope_nodes.find(db.get());
+  if (it == _scope_nodes.end()) {
+    return false;
+  }
+  const auto &hierarchy = db->hierarchy;
+  for (int node = hierarchy.find(pin_name); node >= 0;
+       node = hierarchy.parent(node)) {
+    if (std::ranges::find(it->second, node) != it->second.end()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void analyser::prepare_regions() {
+  if (_regions.empty()) {
+    return;
+  }
+  for (const auto &[_, db] : _dbs) {
+    if (db == nullptr) {
+      continue;
+    }
+    if (db->pin_grid.empty()) {
+      db->build_spatial_index();
+    }
+    auto &mask = _region_nodes[db.get()];
+    mask.assign(db->hierarchy.size(), 0);
+    std::size_t num_pins = 0;
+    for (const auto &region : _regions) {
+      db->pin_grid.query(region, [&](int node) {
+        num_pins += !mask[node];
+        mask[node] = 1;
+      });
+    }
+    fmt::print("Regions hold {} of {} located pins in {} db\n", num_pins,
+               db->pin_grid.size(), db->type);
+  }
+}
+
+bool analyser::in_region(const std::shared_ptr<basedb> &db,
+                         std::string_view pin_name) const {
+  if (_regions.empty()) {
+    return true;
+  }
+  auto it = _region_nodes.find(db.get());
+  if (it == _region_nodes.end()) {
+    return false;
+  }
+  int node = db->hierarchy.find(pin_name);
+  return node >= 0 && it->second[node];
+}
+
+bool analyser::in_region(const std::shared_ptr<basedb> &db,
+                         const std::shared_ptr<Path> &path) const {
+  return _regions.empty() ||
+         std::ranges::any_of(path->path, [&](const std::shared_ptr<Pin> &pin) {
+           return in_region(db, pin->name);
+         });
+}
+
+std::unique_ptr<heatmap> analyser::make_heatmap(
+    const std::shared_ptr<basedb> &db, unsigned int num_slots) const {
+  if (_heatmap_bins[0] <= 0 || _heatmap_bins[1] <= 0 || db == nullptr) {
+    return nullptr;
+  }
+  spatial_grid::window die;
+  if (_heatmap_die.has_value()) {
+    die = _heatmap_die.value();
+  } else {
+    if (db->pin_grid.empty()) {
+      db->build_spatial_index();
+    }
+    if (db->pin_grid.empty()) {
+      fmt::print("No located pins in {} db, skip heatmap\n", db->type);
+      return nullptr;
+    }
+    die = db->pin_grid.bounds();
+  }
+  return std::make_unique<heatmap>(
+      die, _heatmap_bins[0], _heatmap_bins[1],
+      std::vector<std::string>{"delta_delay", "delta_slack", "delta_length"},
+      num_slots);
+}
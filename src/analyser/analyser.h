@@ -7,6 +7,7 @@
 #include "dm/dm.h"
 #include "flow/configs.h"
 #include "utils/csv_writer.h"
+#include "utils/heatmap.h"
 #include "yaml-cpp/yaml.h"
 
 class analyser {
@@ -29,6 +30,34 @@ class analyser {
   virtual void analyse() = 0;
   virtual absl::flat_hash_set<std::string> check_valid(YAML::Node &rpts);
   virtual bool parse_configs();
+  // (key, value) rpts of the tuples when semi_join is on: the value db is
+  // only queried between pins of the key db and may be loaded pruned
+  std::vector<std::pair<std::string, std::string>> semi_join_pairs() const;
+
+ protected:
+  // build the hierarchy of every db and resolve the scopes in it, must run
+  // before any worker thread calls in_scope
+  void prepare_scopes();
+  // true if no scope is configured or the pin is below one of them
+  bool in_scope(const std::shared_ptr<basedb> &db,
+                std::string_view pin_name) const;
+  // build the pin grid of every db and mark the pins inside the regions,
+  // must run before any worker thread calls in_region
+  void prepare_regions();
+  // true if no region is configured or the pin lies inside one of them
+  bool in_region(const std::shared_ptr<basedb> &db,
+                 std::string_view pin_name) const;
+  // an arc or path touching a region is kept
+  bool in_region(const std::shared_ptr<basedb> &db, std::string_view from_pin,
+                 std::string_view to_pin) const {
+    return in_region(db, from_pin) || in_region(db, to_pin);
+  }
+  bool in_region(const std::shared_ptr<basedb> &db,
+                 const std::shared_ptr<Path> &path) const;
+  // heatmap of the delta metrics over the die of the key db, nullptr if no
+  // heatmap is configured or the db has no located pin
+  std::unique_ptr<heatmap> make_heatmap(const std::shared_ptr<basedb> &db,
+                                        unsigned int num_slots) const;
 
  protected:
   YAML::Node _configs;
@@ -36,6 +65,14 @@ class analyser {
   std::vector<std::vector<std::string>> _analyse_tuples;
   std::string _output_dir;
   std::size_t _num_rpts;
+  std::vector<std::string> _scopes;  // hierarchy prefixes to analyse
+  absl::flat_hash_map<const basedb *, std::vector<int>> _scope_nodes;
+  bool _semi_join = false;  // set by the graph analysers only
+  std::vector<spatial_grid::window> _regions;  // die windows to analyse
+  absl::flat_hash_map<const basedb *, std::vector<char>> _region_nodes;
+  std::array<int, 2> _heatmap_bins = {0, 0};  // columns, rows; 0 disables
+  std::optional<spatial_grid::window> _heatmap_die;
+  std::vector<double> _heatmap_percentiles = {50., 90., 99.};
 
  private:
   bool check_file_exists(std::string &file_path);
@@ -46,6 +46,8 @@ void arc_analyser::analyse() {
     _rf_checker.set_enable_rise_fall(true);
   }
   open_writers();
+  prepare_scopes();
+  prepare_regions();
   gen_value_map();
 }
 
@@ -115,10 +117,24 @@ void arc_analyser::match(
         double incr_delay = pin_ptr->incr_delay.value_or(0.);
         return double_filter(_delay_filter_op_code, incr_delay);
       };
+  auto scope_filter =
+      [&](const std::tuple<std::shared_ptr<Pin>, std::shared_ptr<Pin>>
+              pin_ptr_tuple) {
+        const auto &[pin_ptr, _] = pin_ptr_tuple;
+        return in_scope(dbs[0], pin_ptr->name);
+      };
+  auto region_filter =
+      [&](const std::tuple<std::shared_ptr<Pin>, std::shared_ptr<Pin>>
+              pin_ptr_tuple) {
+        const auto &[pin_from, pin_to] = pin_ptr_tuple;
+        return in_region(dbs[0], pin_from->name, pin_to->name);
+      };
   for (const auto &key_path : dbs[0]->paths) {
     for (const auto &pin_tuple : key_path->path | std::views::adjacent<2> |
                                      std::views::filter(delay_filter) |
-                                     std::views::filter(fanout_filter)) {
+                                     std::views::filter(fanout_filter) |
+                                     std::views::filter(scope_filter) |
+                                     std::views::filter(region_filter)) {
       const auto &[pin_from, pin_to] = pin_tuple;
       auto arc_tuple = std::make_tuple(
           pin_from->name, _rf_checker.check(pin_from->rise_fall), pin_to->name,
@@ -153,6 +169,10 @@ void arc_analyser::match(
           node["delta_delay"] = delta_delay;
           node["delta_length"] = node["key"]["length"].get<double>() -
                                  node["value"]["length"].get<double>();
+          if (node["key"].contains("hpwl") && node["value"].contains("hpwl")) {
+            node["delta_hpwl"] = node["key"]["hpwl"].get<double>() -
+                                 node["value"]["hpwl"].get<double>();
+          }
           if (node["key"]["endpoint"].get<std::string>() ==
               node["value"]["endpoint"].get<std::string>()) {
             node["delta_slack"] = key_path->slack - value_path->slack;
@@ -4,6 +4,7 @@
 
 #include <algorithm>
 #include <cstdlib>
+#include <limits>
 #include <thread>
 
 #include "utils/cache_result.h"
@@ -12,6 +13,8 @@
 bool arc_analyser_graph::parse_configs() {
   bool valid = arc_analyser::parse_configs();
   collect_from_node("allow_unplaced_pins", _allow_unplaced_pins);
+  collect_from_node("semi_join", _semi_join);
+  collect_from_node("graph_image_dir", _graph_image_dir);
   return valid;
 }
 
@@ -21,13 +24,19 @@ void arc_analyser_graph::analyse() {
   //   _rf_checker.set_enable_rise_fall(true);
   // }
   open_writers();
+  prepare_scopes();
+  prepare_regions();
   fmt::print("Analyse tuples: {}\n", fmt::join(_analyse_tuples, ", "));
   for (const auto &rpt_pair : _analyse_tuples) {
     std::string cmp_name = fmt::format("{}", fmt::join(rpt_pair, "-"));
     absl::flat_hash_set<std::tuple<std::shared_ptr<Arc>, std::shared_ptr<Arc>>>
         arcs;
     init_graph(_dbs.at(rpt_pair[1]), rpt_pair[1]);
-    csv_match(rpt_pair, _dbs.at(rpt_pair[0])->pins, _dbs.at(rpt_pair[1])->pins);
+    pin_join join;
+    run_function(fmt::format("join pins {}", cmp_name), [&]() {
+      join.build(*_dbs.at(rpt_pair[0]), *_dbs.at(rpt_pair[1]));
+    });
+    csv_match(rpt_pair, join);
   }
 }
 
@@ -37,22 +46,20 @@ void arc_analyser_graph::init_graph(const std::shared_ptr<basedb> &db,
     fmt::print("DB is nullptr, skip\n");
     return;
   }
-  auto rise_graph = std::make_shared<sparse_graph_shortest_path_rf>(true);
-  auto fall_graph = std::make_shared<sparse_graph_shortest_path_rf>(false);
-
-  std::thread rise_thread([&]() { rise_graph->build_graph(db->all_arcs); });
-  std::thread fall_thread([&]() { fall_graph->build_graph(db->all_arcs); });
-  rise_thread.join();
-  fall_thread.join();
-
-  _sparse_graph_ptrs[name] = {rise_graph, fall_graph};
-  rise_graph->print_stats();
+  if (_sparse_graph_ptrs.contains(name)) {
+    return;  // shared by every tuple with this value db
+  }
+  // one topology carrying both the rise and the fall delays
+  auto graph = std::make_shared<sparse_graph_shortest_path_rf>();
+  graph->set_image_dir(_graph_image_dir);
+  graph->build_graph(db->arcs.all());
+  _sparse_graph_ptrs[name] = graph;
+  graph->print_stats();
 }
 
 yyjson_mut_val *arc_analyser_graph::create_pin_node(
     yyjson_mut_doc *doc, std::string_view name_sv, const bool is_input,
-    const std::array<double, 2> &incr_delays,
-    const std::unordered_map<std::string, std::shared_ptr<Pin>> &csv_pin_db,
+    const std::array<double, 2> &incr_delays, const Pin *record,
     const bool is_topin_rise) const {
   yyjson_mut_val *node = yyjson_mut_obj(doc);
   yyjson_mut_obj_add_strncpy(doc, node, "name", name_sv.data(),
@@ -61,66 +68,75 @@ yyjson_mut_val *arc_analyser_graph::create_pin_node(
   yyjson_mut_obj_add_real(doc, node, "incr_delay",
                           is_topin_rise ? incr_delays[0] : incr_delays[1]);
   yyjson_mut_obj_add_bool(doc, node, "rf", is_topin_rise);
-  if (!csv_pin_db.empty()) {
-    if (auto pin_it = csv_pin_db.find(std::string(name_sv));
-        pin_it != csv_pin_db.end()) {
-      const auto &pin = pin_it->second;
-      const auto &path_delays =
-          pin->path_delays.value_or(std::array<double, 2>{0., 0.});
-      yyjson_mut_obj_add_real(doc, node, "path_delay",
-                              is_topin_rise ? path_delays[0] : path_delays[1]);
-      yyjson_mut_val *loc_arr = yyjson_mut_arr(doc);
-      yyjson_mut_arr_add_real(doc, loc_arr, pin->location.first);
-      yyjson_mut_arr_add_real(doc, loc_arr, pin->location.second);
-      yyjson_mut_obj_add_val(doc, node, "location", loc_arr);
-      const auto &trans = pin->transs.value_or(std::array<double, 2>{0., 0.});
-      yyjson_mut_obj_add_real(doc, node, "trans",
-                              is_topin_rise ? trans[0] : trans[1]);
-      const auto &caps = pin->caps.value_or(std::array<double, 2>{0., 0.});
-      yyjson_mut_obj_add_real(doc, node, "cap",
-                              is_topin_rise ? caps[0] : caps[1]);
-    }
+  if (record != nullptr) {
+    const auto &path_delays =
+        record->path_delays.value_or(std::array<double, 2>{0., 0.});
+    yyjson_mut_obj_add_real(doc, node, "path_delay",
+                            is_topin_rise ? path_delays[0] : path_delays[1]);
+    yyjson_mut_val *loc_arr = yyjson_mut_arr(doc);
+    yyjson_mut_arr_add_real(doc, loc_arr, record->location.first);
+    yyjson_mut_arr_add_real(doc, loc_arr, record->location.second);
+    yyjson_mut_obj_add_val(doc, node, "location", loc_arr);
+    const auto &trans =
+        record->transs.value_or(std::array<double, 2>{0., 0.});
+    yyjson_mut_obj_add_real(doc, node, "trans",
+                            is_topin_rise ? trans[0] : trans[1]);
+    const auto &caps = record->caps.value_or(std::array<double, 2>{0., 0.});
+    yyjson_mut_obj_add_real(doc, node, "cap",
+                            is_topin_rise ? caps[0] : caps[1]);
   }
   return node;
 }
 
 void arc_analyser_graph::process_arc_segment(
-    int t, size_t begin_idx, size_t end_idx,
-    const std::vector<std::shared_ptr<Arc>> &arcs,
-    const std::vector<std::string> &rpt_pair,
-    const std::unordered_map<std::string, std::shared_ptr<Pin>> &csv_pin_db_key,
-    const std::unordered_map<std::string, std::shared_ptr<Pin>>
-        &csv_pin_db_value,
+    int t, size_t begin_pin, size_t end_pin,
+    const std::vector<std::string> &rpt_pair, const pin_join &join,
     std::vector<std::vector<std::pair<std::string, std::string>>>
         &thread_buffers,
-    const std::shared_ptr<sparse_graph_shortest_path_rf> &graph_ptr,
-    bool is_topin_rise) {
+    const std::shared_ptr<sparse_graph_shortest_path_rf> &graph_ptr) {
   yyjson_mut_doc *doc = yyjson_mut_doc_new(NULL);
-
-  auto it = arcs.begin();
-  std::advance(it, begin_idx);
-  auto end_it = arcs.begin();
-  std::advance(end_it, end_idx);
-
-  for (; it != end_it; ++it) {
-    const auto &arc = *it;
-    const auto &pin_from = arc->from_pin;
-    const auto &pin_to = arc->to_pin;
-
-    auto connect_check = graph_ptr->query_shortest_distance(pin_from, pin_to);
-
-    if (connect_check.distance >= 0) {
-      auto arc_tuple = std::make_tuple(pin_from, false, pin_to, is_topin_rise);
-      process_single_connection(t, arc, connect_check, rpt_pair, csv_pin_db_key,
-                                csv_pin_db_value, arc_tuple, thread_buffers,
-                                doc);
-    } else {
-      if (is_topin_rise) {
-        fmt::print("No rise connection from {} to {}, skip all operations\n",
-                   pin_from, pin_to);
-      } else {
-        fmt::print("No fall connection from {} to {}, skip\n", pin_from,
-                   pin_to);
+  const auto &key_db = _dbs.at(rpt_pair[0]);
+  const auto &key_arcs = key_db->arcs;
+
+  // the key arcs ending at one pin are answered by one graph sweep, for
+  // both transitions of the pin
+  std::vector<int> arc_ids;
+  std::vector<std::string_view> froms;
+  for (size_t to_id = begin_pin; to_id < end_pin; ++to_id) {
+    arc_ids.clear();
+    froms.clear();
+    for (int arc_id : key_arcs.arcs_to(to_id)) {
+      const auto &arc = key_arcs.arc(arc_id);
+      if (!in_scope(key_db, arc->from_pin) ||
+          !in_region(key_db, arc->from_pin, arc->to_pin)) {
+        continue;
+      }
+      arc_ids.push_back(arc_id);
+      froms.push_back(arc->from_pin);
+    }
+    if (arc_ids.empty()) {
+      continue;
+    }
+    std::string_view pin_to = key_arcs.pin_name(to_id);
+    auto connect_checks = graph_ptr->query_shortest_distances(froms, pin_to);
+
+    for (size_t i = 0; i < arc_ids.size(); ++i) {
+      const auto &pin_from = key_arcs.arc(arc_ids[i])->from_pin;
+      for (bool is_topin_rise : {true, false}) {
+        const auto &connect_check = connect_checks[i][is_topin_rise ? 0 : 1];
+        if (connect_check.distance >= 0) {
+          auto arc_tuple = std::make_tuple(pin_from, false,
+                                           std::string(pin_to), is_topin_rise);
+          process_single_connection(t, arc_ids[i], connect_check, rpt_pair,
+                                    join, arc_tuple, thread_buffers, doc);
+        } else if (is_topin_rise) {
+          fmt::print(
+              "No rise connection from {} to {}, skip all operations\n",
+              pin_from, pin_to);
+        } else {
+          fmt::print("No fall connection from {} to {}, skip\n", pin_from,
+                     pin_to);
+        }
       }
     }
   }
@@ -128,26 +144,29 @@ void arc_analyser_graph::process_arc_segment(
 }
 
 void arc_analyser_graph::process_single_connection(
-    int t, const std::shared_ptr<Arc> &arc, const cache_result &connect_check,
-    const std::vector<std::string> &rpt_pair,
-    const std::unordered_map<std::string, std::shared_ptr<Pin>> &csv_pin_db_key,
-    const std::unordered_map<std::string, std::shared_ptr<Pin>>
-        &csv_pin_db_value,
+    int t, int arc_id, const cache_result &connect_check,
+    const std::vector<std::string> &rpt_pair, const pin_join &join,
     const std::tuple<std::string, bool, std::string, bool> &arc_tuple,
     std::vector<std::vector<std::pair<std::string, std::string>>>
         &thread_buffers,
     yyjson_mut_doc *doc) {
   auto &[pin_from, is_frompin_rise, pin_to, is_topin_rise] = arc_tuple;
+  const auto &key_arcs = _dbs.at(rpt_pair[0])->arcs;
+  const auto &value_arcs = _dbs.at(rpt_pair[1])->arcs;
+  const auto &arc = key_arcs.arc(arc_id);
+  const int key_from = key_arcs.from_id(arc_id);
+  const int key_to = key_arcs.to_id(arc_id);
+  const Pin *key_from_record = join.key_record(key_from);
+  const Pin *key_to_record = join.key_record(key_to);
+  const Pin *value_from_record = join.value_record(key_from);
+  const Pin *value_to_record = join.value_record(key_to);
 
   // FIXME: currently, CP pin of reg does not have their location info
-  if (!_allow_unplaced_pins && (!csv_pin_db_key.contains(pin_to) ||
-                                !csv_pin_db_value.contains(pin_to))) {
+  if (!_allow_unplaced_pins &&
+      (key_to_record == nullptr || value_to_record == nullptr)) {
     return;
   }
 
-  auto from = std::make_pair(pin_from, is_frompin_rise);
-  auto to = std::make_pair(pin_to, is_topin_rise);
-
   double total_delay = 0.;
   if (is_topin_rise) {
     total_delay = arc->delay[0];
@@ -175,10 +194,10 @@ void arc_analyser_graph::process_single_connection(
 
   yyjson_mut_arr_append(
       key_pins, create_pin_node(doc, std::string_view(pin_from), true, {0., 0.},
-                                csv_pin_db_key, is_frompin_rise));
+                                key_from_record, is_frompin_rise));
   yyjson_mut_arr_append(
       key_pins, create_pin_node(doc, std::string_view(pin_to), true, arc->delay,
-                                csv_pin_db_key, is_topin_rise));
+                                key_to_record, is_topin_rise));
 
   yyjson_mut_obj_add_real(doc, key_obj, "delay", total_delay);
 
@@ -191,79 +210,79 @@ void arc_analyser_graph::process_single_connection(
   yyjson_mut_obj_add_real(doc, value_obj, "delay", connect_check.distance);
 
   yyjson_mut_arr_append(
-      value_pins, create_pin_node(doc, std::string_view(pin_from), true,
-                                  {0., 0.}, csv_pin_db_value, is_frompin_rise));
-
-  bool is_cell_arc = arc->type == arc_type::CellArc;
-  auto value_db = _dbs.at(rpt_pair[1]);
-  for (const auto &pin_tuple : connect_check.path | std::views::adjacent<2>) {
-    const auto &[mid_from_view, mid_to_view] = pin_tuple;
-    // std::string mid_from = std::string(mid_from_view);
-    std::shared_ptr<Arc> &mid_arc =
-        is_cell_arc
-            ? value_db
-                  ->cell_arcs_flat[std::make_pair(mid_from_view, mid_to_view)]
-            : value_db
-                  ->net_arcs_flat[std::make_pair(mid_from_view, mid_to_view)];
-    is_cell_arc = !is_cell_arc;
+      value_pins,
+      create_pin_node(doc, std::string_view(pin_from), true, {0., 0.},
+                      value_from_record, is_frompin_rise));
+
+  // records of the value path pins after pin_from, the graph is built on
+  // the value arcs so its arc ids index them
+  std::vector<const Pin *> mid_records;
+  mid_records.reserve(connect_check.arcs.size());
+  for (int mid_arc_id : connect_check.arcs) {
+    const auto &mid_arc = value_arcs.arc(mid_arc_id);
+    int mid_to = value_arcs.to_id(mid_arc_id);
+    const Pin *mid_record = join.value_pin_record(mid_to);
+    mid_records.push_back(mid_record);
+    // the sink of a net arc is a cell input
     yyjson_mut_arr_append(
         value_pins,
-        create_pin_node(doc, mid_to_view, !is_cell_arc, mid_arc->delay,
-                        csv_pin_db_value, is_topin_rise));
+        create_pin_node(doc, value_arcs.pin_name(mid_to),
+                        mid_arc->type == arc_type::NetArc, mid_arc->delay,
+                        mid_record, is_topin_rise));
   }
 
   if (arc->fanout.has_value()) {
     yyjson_mut_obj_add_int(doc, key_obj, "fanout", arc->fanout.value());
   }
 
+  constexpr double nan = std::numeric_limits<double>::quiet_NaN();
+  double delta_slack = nan;
+  double delta_length = nan;
   bool valid_location = true;
-  if (csv_pin_db_key.contains(pin_to)) {
+  if (key_to_record != nullptr) {
     double slack_val = 0;
     if (is_topin_rise) {
-      slack_val = csv_pin_db_key.at(pin_to)->path_slacks.value()[0];
+      slack_val = key_to_record->path_slacks.value()[0];
     } else {
-      slack_val = csv_pin_db_key.at(pin_to)->path_slacks.value()[1];
+      slack_val = key_to_record->path_slacks.value()[1];
     }
     yyjson_mut_obj_add_real(doc, key_obj, "slack", slack_val);
 
-    if (!csv_pin_db_value.empty() && csv_pin_db_value.contains(pin_to)) {
+    if (value_to_record != nullptr) {
       double val_slack = 0;
       if (is_topin_rise) {
-        val_slack = csv_pin_db_value.at(pin_to)->path_slacks.value()[0];
+        val_slack = value_to_record->path_slacks.value()[0];
       } else {
-        val_slack = csv_pin_db_value.at(pin_to)->path_slacks.value()[1];
+        val_slack = value_to_record->path_slacks.value()[1];
       }
       yyjson_mut_obj_add_real(doc, value_obj, "slack", val_slack);
-      yyjson_mut_obj_add_real(doc, node, "delta_slack", slack_val - val_slack);
+      delta_slack = slack_val - val_slack;
+      yyjson_mut_obj_add_real(doc, node, "delta_slack", delta_slack);
     }
   }
 
   std::vector<std::pair<double, double>> locs_key;
   std::vector<std::pair<double, double>> locs_value;
 
-  auto collect_loc = [&](const std::string &p, const auto &db,
+  auto collect_loc = [&](const Pin *record,
                          std::vector<std::pair<double, double>> &locs) {
-    if (db.contains(p)) {
-      locs.push_back(db.at(p)->location);
+    if (record != nullptr) {
+      locs.push_back(record->location);
       return true;
     }
     return false;
   };
 
-  if (!csv_pin_db_key.empty()) {
-    if (!collect_loc(pin_from, csv_pin_db_key, locs_key))
-      valid_location = false;
-    if (!collect_loc(pin_to, csv_pin_db_key, locs_key)) valid_location = false;
+  if (join.key_has_records()) {
+    if (!collect_loc(key_from_record, locs_key)) valid_location = false;
+    if (!collect_loc(key_to_record, locs_key)) valid_location = false;
   }
 
-  if (valid_location && !csv_pin_db_value.empty()) {
-    if (!collect_loc(pin_from, csv_pin_db_value, locs_value))
-      valid_location = false;
+  if (valid_location && join.value_has_records()) {
+    if (!collect_loc(value_from_record, locs_value)) valid_location = false;
 
-    for (const auto &pin_tuple : connect_check.path | std::views::adjacent<2>) {
-      const auto &[_, mid_to_view] = pin_tuple;
-      std::string mid_to = std::string(mid_to_view);
-      if (!collect_loc(mid_to, csv_pin_db_value, locs_value)) {
+    for (const Pin *mid_record : mid_records) {
+      if (!collect_loc(mid_record, locs_value)) {
         valid_location = false;
         break;
       }
@@ -275,11 +294,16 @@ void arc_analyser_graph::process_single_connection(
     double len_v = manhattan_distance(locs_value);
     yyjson_mut_obj_add_real(doc, key_obj, "length", len_k);
     yyjson_mut_obj_add_real(doc, value_obj, "length", len_v);
-    yyjson_mut_obj_add_real(doc, node, "delta_length", len_k - len_v);
+    delta_length = len_k - len_v;
+    yyjson_mut_obj_add_real(doc, node, "delta_length", delta_length);
   }
 
   double delta_delay = total_delay - connect_check.distance;
   yyjson_mut_obj_add_real(doc, node, "delta_delay", delta_delay);
+  if (_heatmap != nullptr && key_to_record != nullptr) {
+    _heatmap->add(t, key_to_record->location,
+                  std::array{delta_delay, delta_slack, delta_length});
+  }
 
   // Store in thread-local buffer
   yyjson_write_err err;
@@ -299,57 +323,35 @@ void arc_analyser_graph::process_single_connection(
   }
 }
 
-void arc_analyser_graph::csv_match(
-    const std::vector<std::string> &rpt_pair,
-    const std::unordered_map<std::string, std::shared_ptr<Pin>> &csv_pin_db_key,
-    const std::unordered_map<std::string, std::shared_ptr<Pin>>
-        &csv_pin_db_value) {
-  const std::vector<std::shared_ptr<Arc>> &arcs =
-      _dbs.at(rpt_pair[0])->all_arcs;
-
+void arc_analyser_graph::csv_match(const std::vector<std::string> &rpt_pair,
+                                   const pin_join &join) {
   if (!_sparse_graph_ptrs.contains(rpt_pair[1])) {
     fmt::print("No graph for type {}\n", rpt_pair[1]);
     return;
   }
-  auto &[rise_graph, fall_graph] = _sparse_graph_ptrs[rpt_pair[1]];
+  const auto &graph = _sparse_graph_ptrs[rpt_pair[1]];
 
+  const std::size_t num_pins = _dbs.at(rpt_pair[0])->arcs.num_pins();
   unsigned int num_threads =
-      std::max(1u, std::min(4u, static_cast<unsigned int>(arcs.size())));
+      std::max(1u, std::min(8u, static_cast<unsigned int>(num_pins)));
   std::vector<std::thread> threads;
-  threads.reserve(num_threads * 2);
-
-  std::unordered_set<std::string_view> arc_starts;
-  for (const auto &arc : arcs) {
-    arc_starts.insert(arc->from_pin);
-  }
+  threads.reserve(num_threads);
 
   std::vector<std::vector<std::pair<std::string, std::string>>> thread_buffers(
-      num_threads * 2);
-  size_t chunk_size_arc = (arcs.size() + num_threads - 1) / num_threads;
+      num_threads);
+  _heatmap = make_heatmap(_dbs.at(rpt_pair[0]), thread_buffers.size());
+  // threads split the key pins, each takes the arcs ending at its pins
+  size_t chunk_size_pin = (num_pins + num_threads - 1) / num_threads;
 
   for (unsigned int t = 0; t < num_threads; ++t) {
-    size_t begin_idx = t * chunk_size_arc;
-    size_t end_idx = std::min(begin_idx + chunk_size_arc, arcs.size());
+    size_t begin_idx = t * chunk_size_pin;
+    size_t end_idx = std::min(begin_idx + chunk_size_pin, num_pins);
 
-    if (begin_idx >= arcs.size()) break;
+    if (begin_idx >= num_pins) break;
 
     threads.emplace_back(&arc_analyser_graph::process_arc_segment, this, t,
-                         begin_idx, end_idx, std::ref(arcs), std::ref(rpt_pair),
-                         std::ref(csv_pin_db_key), std::ref(csv_pin_db_value),
-                         std::ref(thread_buffers), rise_graph, true);
-  }
-
-  for (unsigned int t = 0; t < num_threads; ++t) {
-    size_t begin_idx = t * chunk_size_arc;
-    size_t end_idx = std::min(begin_idx + chunk_size_arc, arcs.size());
-
-    if (begin_idx >= arcs.size()) break;
-
-    threads.emplace_back(&arc_analyser_graph::process_arc_segment, this,
-                         t + num_threads, begin_idx, end_idx, std::ref(arcs),
-                         std::ref(rpt_pair), std::ref(csv_pin_db_key),
-                         std::ref(csv_pin_db_value), std::ref(thread_buffers),
-                         fall_graph, false);
+                         begin_idx, end_idx, std::ref(rpt_pair),
+                         std::ref(join), std::ref(thread_buffers), graph);
   }
 
   // Wait for all threads
@@ -359,14 +361,7 @@ void arc_analyser_graph::csv_match(
     }
   }
 
-  for (auto [name, time] :
-       _sparse_graph_ptrs[rpt_pair[1]].first->timing_stats) {
-    fmt::print("Rise graph: Timing stats {}: {} s\n", name, time / 1e6);
-  }
-  for (auto [name, time] :
-       _sparse_graph_ptrs[rpt_pair[1]].second->timing_stats) {
-    fmt::print("Fall graph: Timing stats {}: {} s\n", name, time / 1e6);
-  }
+  graph->print_stats();
 
   std::vector<std::pair<std::string, std::string>> all_results;
   for (auto &buf : thread_buffers) {
@@ -390,4 +385,9 @@ void arc_analyser_graph::csv_match(
 
   fmt::print("Wrote {} arc match results to {}\n", all_results.size(),
              cmp_name);
+  if (_heatmap != nullptr) {
+    _heatmap->write(fmt::format("{}_heatmap.csv", cmp_name), _output_dir,
+                    _heatmap_percentiles);
+    _heatmap.reset();
+  }
 }
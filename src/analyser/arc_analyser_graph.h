@@ -2,6 +2,7 @@
 #include <string_view>
 
 #include "arc_analyser.h"
+#include "dm/pin_join.h"
 #include "utils/sparse_graph_shortest_path_rf.h"
 #include "yyjson.h"
 
@@ -12,38 +13,27 @@ class arc_analyser_graph : public arc_analyser {
   void init_graph(const std::shared_ptr<basedb> &db, std::string name);
 
   void csv_match(const std::vector<std::string> &rpt_pair,
-                 const std::unordered_map<std::string, std::shared_ptr<Pin>>
-                     &csv_pin_db_key,
-                 const std::unordered_map<std::string, std::shared_ptr<Pin>>
-                     &csv_pin_db_value);
+                 const pin_join &join);
 
-  yyjson_mut_val *create_pin_node(
-      yyjson_mut_doc *doc, std::string_view name_sv, const bool is_input,
-      const std::array<double, 2> &incr_delays,
-      const std::unordered_map<std::string, std::shared_ptr<Pin>> &csv_pin_db,
-      const bool is_topin_rise) const;
+  yyjson_mut_val *create_pin_node(yyjson_mut_doc *doc,
+                                  std::string_view name_sv,
+                                  const bool is_input,
+                                  const std::array<double, 2> &incr_delays,
+                                  const Pin *record,
+                                  const bool is_topin_rise) const;
 
+  // key arcs ending at pins [begin_pin, end_pin) of the key arc_store
   void process_arc_segment(
-      int t, size_t begin_idx, size_t end_idx,
-      const std::vector<std::shared_ptr<Arc>> &arcs,
-      const std::vector<std::string> &rpt_pair,
-      const std::unordered_map<std::string, std::shared_ptr<Pin>>
-          &csv_pin_db_key,
-      const std::unordered_map<std::string, std::shared_ptr<Pin>>
-          &csv_pin_db_value,
+      int t, size_t begin_pin, size_t end_pin,
+      const std::vector<std::string> &rpt_pair, const pin_join &join,
       std::vector<std::vector<std::pair<std::string, std::string>>>
           &thread_buffers,
-      const std::shared_ptr<sparse_graph_shortest_path_rf> &graph_ptr,
-      bool is_topin_rise);
+      const std::shared_ptr<sparse_graph_shortest_path_rf> &graph_ptr);
 
  private:
   void process_single_connection(
-      int t, const std::shared_ptr<Arc> &arc, const cache_result &connect_check,
-      const std::vector<std::string> &rpt_pair,
-      const std::unordered_map<std::string, std::shared_ptr<Pin>>
-          &csv_pin_db_key,
-      const std::unordered_map<std::string, std::shared_ptr<Pin>>
-          &csv_pin_db_value,
+      int t, int arc_id, const cache_result &connect_check,
+      const std::vector<std::string> &rpt_pair, const pin_join &join,
       const std::tuple<std::string, bool, std::string, bool> &arc_tuple,
       std::vector<std::vector<std::pair<std::string, std::string>>>
           &thread_buffers,
@@ -52,8 +42,9 @@ class arc_analyser_graph : public arc_analyser {
 
  private:
   std::unordered_map<std::string,
-                     std::pair<std::shared_ptr<sparse_graph_shortest_path_rf>,
-                               std::shared_ptr<sparse_graph_shortest_path_rf>>>
+                     std::shared_ptr<sparse_graph_shortest_path_rf>>
       _sparse_graph_ptrs;
   bool _allow_unplaced_pins = true;
+  std::string _graph_image_dir;  // empty: no graph images
+  std::unique_ptr<heatmap> _heatmap;  // of the tuple being matched
 };
@@ -18,17 +18,17 @@ void existence_checker::check_existence(const std::shared_ptr<basedb> &db,
   const auto &cell_maps = db->type_map;
   for (const auto &path : db->paths) {
     for (const auto &pin : path->path) {
-      std::size_t pos = pin->name.find_last_of('/');
-      if (pos == std::string::npos) {
+      std::string_view name = pin->name;
+      std::size_t pos = name.find_last_of('/');
+      if (pos == std::string_view::npos) {
         continue;
       }
-      std::string cell_name = pin->name.substr(0, pos);
-      if (cell_maps.contains(cell_name)) {
-        if (cell_maps.at(cell_name) != pin->cell) {
-          fmt::print(invalid_writer.out_file,
-                     "Pin: {}, Cell: {}, Expected: {}\n", pin->name,
-                     pin->cell.value_or(""), cell_maps.at(cell_name));
-        }
+      // heterogeneous lookup, the instance name is not copied
+      auto it = cell_maps.find(name.substr(0, pos));
+      if (it != cell_maps.end() && it->second != pin->cell) {
+        fmt::print(invalid_writer.out_file,
+                   "Pin: {}, Cell: {}, Expected: {}\n", pin->name,
+                   pin->cell.value_or(""), it->second);
       }
     }
   }
@@ -49,11 +49,19 @@ void pair_analyser::match(
       return false;
     }
   };
+  auto region_filter =
+      [&](const std::tuple<std::shared_ptr<Pin>, std::shared_ptr<Pin>,
+                           std::shared_ptr<Pin>>
+              pin_ptr_tuple) {
+        const auto &[pin_from, _, pin_to] = pin_ptr_tuple;
+        return in_region(dbs[0], pin_from->name, pin_to->name);
+      };
   for (const auto &key_path : dbs[0]->paths) {
     for (const auto &pin_tuple : key_path->path | std::views::adjacent<3> |
                                      std::views::filter(drop_filter) |
                                      std::views::filter(delay_filter) |
-                                     std::views::filter(fanout_filter)) {
+                                     std::views::filter(fanout_filter) |
+                                     std::views::filter(region_filter)) {
       const auto &[pin_from, pin_inter, pin_to] = pin_tuple;
       auto arc_tuple = std::make_tuple(
           pin_from->name, _rf_checker.check(pin_from->rise_fall), pin_to->name,
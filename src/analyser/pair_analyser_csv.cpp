@@ -116,28 +116,27 @@ void pair_analyser_csv::gen_arc_tuples(
     const std::shared_ptr<basedb> &db,
     absl::flat_hash_set<std::tuple<std::shared_ptr<Arc>, std::shared_ptr<Arc>>>
         &arcs) {
-  for (const auto &[cell_to, cell_arcs] : db->cell_arcs_rev) {
-    if (db->net_arcs.contains(cell_to)) {
-      auto &net_arc_map = db->net_arcs.at(cell_to);
-      if (net_arc_map.empty()) {
-        fmt::print("No net arcs for cell {}\n", cell_to);
-        continue;  // Skip if there are no net arcs for this cell
+  const auto &store = db->arcs;
+  // pair every cell arc with each net arc leaving its to pin
+  for (int cell_id = 0; cell_id < static_cast<int>(store.size()); ++cell_id) {
+    const auto &cell_arc = store.arc(cell_id);
+    if (cell_arc->type != arc_type::CellArc) {
+      continue;
+    }
+    for (int net_id : store.arcs_from(store.to_id(cell_id))) {
+      const auto &net_arc = store.arc(net_id);
+      if (net_arc->type != arc_type::NetArc ||
+          !in_region(db, cell_arc->from_pin, net_arc->to_pin)) {
+        continue;
       }
-      for (const auto &[cell_from, cell_arc] : cell_arcs) {
-        for (const auto &[net_from, net_arc] : net_arc_map) {
-          std::tuple<std::shared_ptr<Arc>, std::shared_ptr<Arc>> arc_tuple(
-              cell_arc, net_arc);
-          if (arcs.contains(arc_tuple)) {
-            fmt::print("Skip arc tuple: {} - {}\n", cell_arc->from_pin,
-                       net_arc->to_pin);
-            continue;  // Skip if the arc tuple already exists
-          } else {
-            arcs.insert(arc_tuple);
-            // fmt::print("Add arc tuple: {} - {}\n", cell_arc->from_pin,
-            //            net_arc->to_pin);
-          }
-        }
+      std::tuple<std::shared_ptr<Arc>, std::shared_ptr<Arc>> arc_tuple(
+          cell_arc, net_arc);
+      if (arcs.contains(arc_tuple)) {
+        fmt::print("Skip arc tuple: {} - {}\n", cell_arc->from_pin,
+                   net_arc->to_pin);
+        continue;  // Skip if the arc tuple already exists
       }
+      arcs.insert(arc_tuple);
     }
   }
 }
@@ -148,6 +147,7 @@ void pair_analyser_csv::analyse() {
     _rf_checker.set_enable_rise_fall(true);
   }
   open_writers();
+  prepare_regions();
   std::vector<std::thread> threads;
   fmt::print("Analyse tuples: {}\n", fmt::join(_analyse_tuples, ", "));
   for (const auto &rpt_pair : _analyse_tuples) {
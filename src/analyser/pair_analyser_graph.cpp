@@ -8,12 +8,20 @@
 #include "utils/cache_result.h"
 #include "utils/utils.h"
 
+bool pair_analyser_graph::parse_configs() {
+  bool valid = pair_analyser_csv::parse_configs();
+  collect_from_node("semi_join", _semi_join);
+  collect_from_node("graph_image_dir", _graph_image_dir);
+  return valid;
+}
+
 void pair_analyser_graph::analyse() {
   // if (_enable_rise_fall) {
   //   fmt::print("Enable rise fall check\n");
   //   _rf_checker.set_enable_rise_fall(true);
   // }
   open_writers();
+  prepare_regions();
   fmt::print("Analyse tuples: {}\n", fmt::join(_analyse_tuples, ", "));
   for (const auto &rpt_pair : _analyse_tuples) {
     std::string cmp_name = fmt::format("{}", fmt::join(rpt_pair, "-"));
@@ -32,8 +40,12 @@ void pair_analyser_graph::init_graph(const std::shared_ptr<basedb> &db,
     fmt::print("DB is nullptr, skip\n");
     return;
   }
+  if (_sparse_graph_ptrs.contains(name)) {
+    return;  // shared by every tuple with this value db
+  }
   auto graph = std::make_shared<sparse_graph_shortest_path>();
-  graph->build_graph(db->all_arcs);
+  graph->set_image_dir(_graph_image_dir);
+  graph->build_graph(db->arcs.all());
   _sparse_graph_ptrs[name] = graph;
   graph->print_stats();
 }
@@ -124,18 +136,13 @@ void pair_analyser_graph::process_arc_segment(
     node["value"]["pins"].push_back(
         create_pin_node(pin_from, true, 0, csv_pin_db_value));
 
-    bool is_cell_arc = true;
+    // the graph is built on the value arcs, its arc ids index them
     auto value_db = _dbs.at(rpt_pair[1]);
-    for (const auto &pin_tuple : connect_check.path | std::views::adjacent<2>) {
-      const auto &[mid_from_view, mid_to_view] = pin_tuple;
-      std::string mid_from = std::string(mid_from_view);
-      std::string mid_to = std::string(mid_to_view);
-      std::shared_ptr<Arc> &mid_arc =
-          is_cell_arc ? value_db->cell_arcs[mid_from][mid_to]
-                      : value_db->net_arcs[mid_from][mid_to];
-      is_cell_arc = !is_cell_arc;
+    for (int mid_arc_id : connect_check.arcs) {
+      const auto &mid_arc = value_db->arcs.arc(mid_arc_id);
       node["value"]["pins"].push_back(create_pin_node(
-          mid_to, !is_cell_arc, mid_arc->delay[0], csv_pin_db_value));
+          mid_arc->to_pin, mid_arc->type == arc_type::NetArc,
+          mid_arc->delay[0], csv_pin_db_value));
     }
 
     if (arc_net->fanout.has_value()) {
@@ -247,9 +254,7 @@ void pair_analyser_graph::csv_match(
   for (auto &buffer : thread_buffers) {
     arcs_buffer.insert(buffer.begin(), buffer.end());
   }
-  for (auto [name, time] : _sparse_graph_ptrs[rpt_pair[1]]->timing_stats) {
-    fmt::print("Timing stats {}: {} s\n", name, time / 1e6);
-  }
+  _sparse_graph_ptrs[rpt_pair[1]]->print_stats();
   nlohmann::json arc_node;
   for (const auto &[arc, _] : arcs_buffer) {
     arc_node[fmt::format(
@@ -10,6 +10,7 @@
 class pair_analyser_graph : public pair_analyser_csv {
  public:
   pair_analyser_graph(const YAML::Node &configs) : pair_analyser_csv(configs){};
+  bool parse_configs() override;
   void analyse() override;
   void init_graph(const std::shared_ptr<basedb> &db, std::string name);
   void csv_match(const std::vector<std::string> &rpt_pair,
@@ -39,4 +40,5 @@ class pair_analyser_graph : public pair_analyser_csv {
  private:
   absl::flat_hash_map<std::string, std::shared_ptr<sparse_graph_shortest_path>>
       _sparse_graph_ptrs;
+  std::string _graph_image_dir;  // empty: no graph images
 };
@@ -79,6 +79,7 @@ void path_analyser::analyse() {
     _rf_checker.set_enable_rise_fall(true);
   }
   open_writers();
+  prepare_regions();
   gen_headers();
   for (const auto &rpt_pair : _analyse_tuples) {
     std::vector<absl::flat_hash_map<std::string, std::shared_ptr<Path>>>
@@ -86,7 +87,15 @@ void path_analyser::analyse() {
     std::ranges::transform(
         rpt_pair, std::back_inserter(path_maps), [&](const auto &rpt) {
           absl::flat_hash_map<std::string, std::shared_ptr<Path>> path_map;
-          gen_endpoints_map(_dbs[rpt]->type, _dbs[rpt]->paths, path_map);
+          const auto &db = _dbs[rpt];
+          // only key paths are restricted, their value paths may leave it
+          bool is_key = rpt == rpt_pair[0];
+          gen_endpoints_map(
+              db->type,
+              db->paths | std::views::filter([&](const auto &path) {
+                return !is_key || in_region(db, path);
+              }),
+              path_map);
           return path_map;
         });
     std::vector<std::shared_ptr<basedb>> dbs;
@@ -156,6 +165,7 @@ void path_analyser::match(
         _arcs_buffer[arc];
   }
   fmt::print(_writers["arc"][cmp_name]->out_file, "{}", arc_node.dump(2));
+  write_heatmap(cmp_name, dbs[0]);
 
   // write all paths
   std::vector<std::pair<std::string, nlohmann::json>> sorted_paths(
@@ -185,6 +195,42 @@ void path_analyser::match(
   _csv_writer->add_row(row);
 }
 
+void path_analyser::write_heatmap(const std::string &cmp_name,
+                                  const std::shared_ptr<basedb> &key_db) {
+  const unsigned int num_threads = default_num_threads();
+  auto map = make_heatmap(key_db, num_threads);
+  if (map == nullptr) {
+    return;
+  }
+  std::vector<const nlohmann::json *> nodes;
+  nodes.reserve(_arcs_buffer.size());
+  for (const auto &[_, node] : _arcs_buffer) {
+    nodes.push_back(&node);
+  }
+  // an arc is placed at its to pin, its slacks are the worst of its paths
+  parallel_for(
+      nodes.size(),
+      [&](unsigned int t, std::size_t begin_idx, std::size_t end_idx) {
+        for (std::size_t i = begin_idx; i < end_idx; ++i) {
+          const auto &node = *nodes[i];
+          const auto &key = node.at("key");
+          const auto &value = node.at("value");
+          if (key.at("pins").empty()) {
+            continue;
+          }
+          const auto &loc = key.at("pins").back().at("location");
+          map->add(t, {loc[0].get<double>(), loc[1].get<double>()},
+                   std::array{node.at("delta_delay").get<double>(),
+                              key.at("slack").get<double>() -
+                                  value.at("slack").get<double>(),
+                              node.at("delta_length").get<double>()});
+        }
+      },
+      num_threads);
+  map->write(fmt::format("{}_heatmap.csv", cmp_name), _output_dir,
+             _heatmap_percentiles, num_threads);
+}
+
 nlohmann::json path_analyser::path_analyse(
     const std::vector<std::shared_ptr<Path>> &paths) {
   auto key_path = paths[0];
@@ -279,6 +325,10 @@ nlohmann::json path_analyser::path_analyse(
         node["delta_delay"] = delta_delay;
         node["delta_length"] = node["key"]["length"].get<double>() -
                                node["value"]["length"].get<double>();
+        if (node["key"].contains("hpwl") && node["value"].contains("hpwl")) {
+          node["delta_hpwl"] = node["key"]["hpwl"].get<double>() -
+                               node["value"]["hpwl"].get<double>();
+        }
 
         std::vector<std::unordered_map<std::string, double>> attributes;
         for (const auto &iter : {"key", "value"}) {
@@ -28,6 +28,8 @@ class path_analyser : public analyser {
       const std::vector<absl::flat_hash_map<std::string, std::shared_ptr<Path>>>
           &path_maps,
       const std::vector<std::shared_ptr<basedb>> &dbs);
+  void write_heatmap(const std::string &cmp_name,
+                     const std::shared_ptr<basedb> &key_db);
   void gen_endpoints_map(
       const std::string &type, std::ranges::input_range auto &&paths,
       absl::flat_hash_map<std::string, std::shared_ptr<Path>> &path_map);
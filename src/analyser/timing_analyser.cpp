@@ -0,0 +1,190 @@
+#include "analyser/timing_analyser.h"
+
+#include <fmt/ranges.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "utils/utils.h"
+
+bool timing_analyser::parse_configs() {
+  bool valid = analyser::parse_configs();
+  collect_from_node("graph_image_dir", _graph_image_dir);
+  collect_from_node("at_tolerance", _at_tolerance);
+  _validation_writer = std::make_unique<csv_writer>(
+      "timing_validation.csv",
+      std::vector<std::string>{"Rpt", "Pins", "Rise mean error",
+                               "Rise max error", "Fall mean error",
+                               "Fall max error", "Mismatches"});
+  _validation_writer->set_output_dir(_output_dir);
+  return valid;
+}
+
+std::shared_ptr<timing_graph> timing_analyser::init_graph(
+    const std::string &key) {
+  if (auto it = _graphs.find(key); it != _graphs.end()) {
+    return it->second;
+  }
+  const auto &db = _dbs.at(key);
+  if (db == nullptr) {
+    fmt::print("DB is nullptr, skip\n");
+    return nullptr;
+  }
+  auto graph = std::make_shared<timing_graph>();
+  graph->set_image_dir(_graph_image_dir);
+  run_function(fmt::format("build graph {}", key),
+               [&]() { graph->build_graph(db->arcs.all()); });
+  run_function(fmt::format("propagate {}", key),
+               [&]() { graph->propagate(db->pins); });
+  graph->print_stats();
+  graph->print_timing_stats();
+  validate(key, *graph);
+  _graphs[key] = graph;
+  return graph;
+}
+
+void timing_analyser::validate(const std::string &key,
+                               const timing_graph &graph) {
+  struct errors {
+    std::size_t pins = 0;
+    std::array<double, 2> sum = {0., 0.};
+    std::array<double, 2> max = {0., 0.};
+    std::size_t mismatches = 0;
+  };
+  const auto &pins = _dbs.at(key)->pins;
+  std::vector<errors> thread_errors(default_num_threads());
+  parallel_for(
+      graph.num_pins(),
+      [&](unsigned int t, std::size_t begin_idx, std::size_t end_idx) {
+        auto &err = thread_errors[t];
+        for (std::size_t i = begin_idx; i < end_idx; ++i) {
+          int id = static_cast<int>(i);
+          auto it = pins.find(std::string(graph.pin_name(id)));
+          if (it == pins.end() || !it->second->path_delays.has_value()) {
+            continue;
+          }
+          const auto &golden = it->second->path_delays.value();
+          const auto &at = graph.timing(id).max_at;
+          if (!std::isfinite(at[0]) || !std::isfinite(at[1])) {
+            continue;
+          }
+          ++err.pins;
+          bool mismatch = false;
+          for (int k : {0, 1}) {
+            double diff = std::abs(at[k] - golden[k]);
+            err.sum[k] += diff;
+            err.max[k] = std::max(err.max[k], diff);
+            mismatch = mismatch || diff > _at_tolerance;
+          }
+          err.mismatches += mismatch;
+        }
+      },
+      thread_errors.size());
+  errors total;
+  for (const auto &err : thread_errors) {
+    total.pins += err.pins;
+    total.mismatches += err.mismatches;
+    for (int k : {0, 1}) {
+      total.sum[k] += err.sum[k];
+      total.max[k] = std::max(total.max[k], err.max[k]);
+    }
+  }
+  auto mean = [&](int k) {
+    return total.pins > 0 ? total.sum[k] / total.pins : 0.;
+  };
+  fmt::print(
+      "Arrival of {} against its at csv: {} pins, {} over {}, max error "
+      "{}/{}\n",
+      key, total.pins, total.mismatches, _at_tolerance, total.max[0],
+      total.max[1]);
+  _validation_writer->add_row(
+      {key, std::to_string(total.pins), fmt::format("{}", mean(0)),
+       fmt::format("{}", total.max[0]), fmt::format("{}", mean(1)),
+       fmt::format("{}", total.max[1]), std::to_string(total.mismatches)});
+}
+
+void timing_analyser::compare(const std::vector<std::string> &rpt_pair) {
+  std::string cmp_name = fmt::format("{}", fmt::join(rpt_pair, "-"));
+  auto key_graph = init_graph(rpt_pair[0]);
+  auto value_graph = init_graph(rpt_pair[1]);
+  if (key_graph == nullptr || value_graph == nullptr) {
+    return;
+  }
+
+  std::vector<std::string> headers = {"pin"};
+  for (const auto &rpt : rpt_pair) {
+    for (auto column : {"max_rise_at", "max_fall_at", "min_rise_at",
+                        "min_fall_at", "rise_slack", "fall_slack"}) {
+      headers.push_back(fmt::format("{}_{}", rpt, column));
+    }
+  }
+  for (auto column : {"delta_rise_at", "delta_fall_at", "delta_rise_slack",
+                      "delta_fall_slack"}) {
+    headers.push_back(column);
+  }
+
+  // one row per pin of the key graph, in its id order
+  std::vector<std::vector<std::string>> rows(key_graph->num_pins());
+  std::vector<std::size_t> thread_matched(default_num_threads(), 0);
+  parallel_for(
+      rows.size(),
+      [&](unsigned int t, std::size_t begin_idx, std::size_t end_idx) {
+        for (std::size_t i = begin_idx; i < end_idx; ++i) {
+          const int key_id = static_cast<int>(i);
+          const auto name = key_graph->pin_name(key_id);
+          const int value_id = value_graph->pin_id(name);
+          auto &row = rows[i];
+          row.reserve(headers.size());
+          row.emplace_back(name);
+          std::array<timing_graph::weights, 2> at;
+          std::array<timing_graph::weights, 2> slack;
+          const std::array<std::pair<const timing_graph *, int>, 2> pins = {
+              {{key_graph.get(), key_id}, {value_graph.get(), value_id}}};
+          for (int r : {0, 1}) {
+            const auto &[graph, id] = pins[r];
+            if (id == -1) {
+              row.insert(row.end(), 6, "");
+              at[r] = slack[r] = {NAN, NAN};
+              continue;
+            }
+            const auto &timing = graph->timing(id);
+            at[r] = timing.max_at;
+            slack[r] = graph->slack(id);
+            for (double value : {timing.max_at[0], timing.max_at[1],
+                                 timing.min_at[0], timing.min_at[1],
+                                 slack[r][0], slack[r][1]}) {
+              row.push_back(format_time(value));
+            }
+          }
+          thread_matched[t] += value_id != -1;
+          for (const auto &values : {at, slack}) {
+            for (int k : {0, 1}) {
+              row.push_back(format_time(values[1][k] - values[0][k]));
+            }
+          }
+        }
+      },
+      thread_matched.size());
+
+  csv_writer out(fmt::format("{}_timing.csv", cmp_name), headers);
+  out.set_output_dir(_output_dir);
+  for (const auto &row : rows) {
+    out.add_row(row);
+  }
+  out.write();
+  std::size_t matched = 0;
+  for (std::size_t count : thread_matched) {
+    matched += count;
+  }
+  fmt::print("Compared {} pins of {}, {} of them in {}\n", rows.size(),
+             rpt_pair[0], matched, rpt_pair[1]);
+}
+
+void timing_analyser::analyse() {
+  fmt::print("Analyse tuples: {}\n", fmt::join(_analyse_tuples, ", "));
+  for (const auto &rpt_pair : _analyse_tuples) {
+    run_function(fmt::format("timing {}", fmt::join(rpt_pair, "-")),
+                 [&]() { compare(rpt_pair); });
+  }
+  _validation_writer->write();
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include "analyser.h"
+#include "utils/timing_graph.h"
+
+// timing_analyser propagates the arrival and required times of every pin of
+// two csv dbs over their arc graphs and compares them pin by pin; the
+// propagated arrivals of each db are checked against its at csv.
+class timing_analyser : public analyser {
+ public:
+  timing_analyser(const YAML::Node &configs) : analyser(configs, 2){};
+  ~timing_analyser() override = default;
+  void analyse() override;
+
+ private:
+  bool parse_configs() override;
+  // built and propagated once per db
+  std::shared_ptr<timing_graph> init_graph(const std::string &key);
+  // propagated max arrival against max_rise/fall_at of the at csv rows
+  void validate(const std::string &key, const timing_graph &graph);
+  void compare(const std::vector<std::string> &rpt_pair);
+
+ private:
+  std::unordered_map<std::string, std::shared_ptr<timing_graph>> _graphs;
+  std::string _graph_image_dir;  // empty: no graph images
+  double _at_tolerance = 1e-3;   // a larger error counts as a mismatch
+  std::unique_ptr<csv_writer> _validation_writer;
+};
@@ -0,0 +1,87 @@
+#include "analyser/timing_update_analyser.h"
+
+#include <fmt/color.h>
+#include <fmt/ranges.h>
+
+#include "parser/csv_parser.h"
+#include "utils/utils.h"
+
+bool timing_update_analyser::parse_configs() {
+  bool valid = analyser::parse_configs();
+  // delay_override: one csv or a list of them
+  if (const auto &node = _configs["delay_override"]; node) {
+    if (node.IsSequence()) {
+      _delay_overrides = node.as<std::vector<std::string>>();
+    } else {
+      _delay_overrides.push_back(node.as<std::string>());
+    }
+  }
+  if (_delay_overrides.empty()) {
+    fmt::print("delay_override is not defined in configs\n");
+    return false;
+  }
+  collect_from_node("graph_image_dir", _graph_image_dir);
+  return valid;
+}
+
+void timing_update_analyser::update(const std::string &key) {
+  const auto &db = _dbs.at(key);
+  if (db == nullptr) {
+    fmt::print("DB is nullptr, skip\n");
+    return;
+  }
+  timing_graph graph;
+  graph.set_image_dir(_graph_image_dir);
+  run_function(fmt::format("build graph {}", key),
+               [&]() { graph.build_graph(db->arcs.all()); });
+  run_function(fmt::format("propagate {}", key),
+               [&]() { graph.propagate(db->pins); });
+  graph.print_timing_stats();
+
+  csv_parser parser;
+  std::vector<std::pair<csv_type, std::string>> files;
+  for (const auto &file : _delay_overrides) {
+    files.emplace_back(csv_type::NetArc, file);
+  }
+  fmt::print("Parsing delay overrides {}\n", fmt::join(_delay_overrides, ", "));
+  if (!parser.parse_files(files)) {
+    fmt::print(fmt::fg(fmt::color::red),
+               "Cannot parse delay overrides, skip.\n");
+    return;
+  }
+  const auto &arcs = parser.get_db().arcs.all();
+  std::vector<timing_graph::delay_change> changes;
+  changes.reserve(arcs.size());
+  for (const auto &arc : arcs) {
+    changes.push_back({arc->from_pin, arc->to_pin, arc->delay});
+  }
+
+  timing_graph::update_result result;
+  run_function(fmt::format("update delays {}", key),
+               [&]() { result = graph.update_delays(changes); });
+  fmt::print(
+      "Updated {} arcs ({} not in {}): {} arrivals and {} required times of "
+      "{} pins recomputed, {} endpoints changed\n",
+      result.changed_arcs, result.unknown_arcs, key, result.arrivals,
+      result.requireds, graph.num_pins(), result.endpoints.size());
+
+  csv_writer out(fmt::format("{}_endpoint_slacks.csv", key),
+                 {"endpoint", "rise_slack_before", "fall_slack_before",
+                  "rise_slack", "fall_slack", "delta_rise_slack",
+                  "delta_fall_slack"});
+  out.set_output_dir(_output_dir);
+  for (const auto &[id, before] : result.endpoints) {
+    auto after = graph.slack(id);
+    out.add_row({std::string(graph.pin_name(id)), format_time(before[0]),
+                 format_time(before[1]), format_time(after[0]),
+                 format_time(after[1]), format_time(after[0] - before[0]),
+                 format_time(after[1] - before[1])});
+  }
+  out.write();
+}
+
+void timing_update_analyser::analyse() {
+  for (const auto &rpt_tuple : _analyse_tuples) {
+    update(rpt_tuple[0]);
+  }
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include "analyser.h"
+#include "utils/timing_graph.h"
+
+// timing_update_analyser propagates the timing of a csv db once, applies a
+// delay override csv (same columns as the cell / net delay csv) through the
+// incremental update and reports the endpoints whose slack moved.
+class timing_update_analyser : public analyser {
+ public:
+  timing_update_analyser(const YAML::Node &configs) : analyser(configs, 1){};
+  ~timing_update_analyser() override = default;
+  void analyse() override;
+
+ private:
+  bool parse_configs() override;
+  void update(const std::string &key);
+
+ private:
+  std::vector<std::string> _delay_overrides;  // csv files, applied in order
+  std::string _graph_image_dir;               // empty: no graph images
+};
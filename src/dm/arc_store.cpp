@@ -0,0 +1,246 @@
+#include "dm/arc_store.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+#include "dm/dm.h"
+
+std::size_t arc_store::shard_of(std::string_view name) const {
+  return std::hash<std::string_view>{}(name) % _pin_shards.size();
+}
+
+void arc_store::build_index(unsigned int num_threads) {
+  const std::size_t num_arcs = _arcs.size();
+  const std::size_t num_shards = std::max(1u, num_threads);
+  _pin_shards.assign(num_shards, {});
+  _arc_from.assign(num_arcs, -1);
+  _arc_to.assign(num_arcs, -1);
+
+  // every pin name is owned by exactly one shard, hash once up front
+  std::vector<uint16_t> from_shard(num_arcs);
+  std::vector<uint16_t> to_shard(num_arcs);
+  parallel_for(
+      num_arcs,
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        for (std::size_t i = begin_idx; i < end_idx; ++i) {
+          from_shard[i] = shard_of(_arcs[i]->from_pin);
+          to_shard[i] = shard_of(_arcs[i]->to_pin);
+        }
+      },
+      num_threads);
+
+  // intern per shard, a shard only writes the endpoints it owns
+  std::vector<std::vector<std::string_view>> shard_names(num_shards);
+  parallel_for(
+      num_shards,
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        for (std::size_t s = begin_idx; s < end_idx; ++s) {
+          auto &ids = _pin_shards[s];
+          auto &names = shard_names[s];
+          auto intern = [&](std::string_view name) {
+            auto [it, inserted] =
+                ids.try_emplace(name, static_cast<int>(names.size()));
+            if (inserted) {
+              names.push_back(name);
+            }
+            return it->second;
+          };
+          for (std::size_t i = 0; i < num_arcs; ++i) {
+            if (from_shard[i] == s) {
+              _arc_from[i] = intern(_arcs[i]->from_pin);
+            }
+            if (to_shard[i] == s) {
+              _arc_to[i] = intern(_arcs[i]->to_pin);
+            }
+          }
+        }
+      },
+      num_threads);
+
+  std::vector<int> shard_base(num_shards + 1, 0);
+  for (std::size_t s = 0; s < num_shards; ++s) {
+    shard_base[s + 1] = shard_base[s] + shard_names[s].size();
+  }
+  const std::size_t num_pins = shard_base[num_shards];
+  _pin_names.resize(num_pins);
+  parallel_for(
+      num_shards,
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        for (std::size_t s = begin_idx; s < end_idx; ++s) {
+          std::ranges::copy(shard_names[s],
+                            _pin_names.begin() + shard_base[s]);
+          for (auto &[_, id] : _pin_shards[s]) {
+            id += shard_base[s];
+          }
+        }
+      },
+      num_threads);
+  parallel_for(
+      num_arcs,
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        for (std::size_t i = begin_idx; i < end_idx; ++i) {
+          _arc_from[i] += shard_base[from_shard[i]];
+          _arc_to[i] += shard_base[to_shard[i]];
+        }
+      },
+      num_threads);
+
+  // counting sort into CSR rows, forward and reverse side by side
+  auto build_csr = [num_arcs, num_pins](const std::vector<int> &keys,
+                                        std::vector<std::size_t> &offsets,
+                                        std::vector<int> &rows) {
+    offsets.assign(num_pins + 1, 0);
+    for (std::size_t i = 0; i < num_arcs; ++i) {
+      ++offsets[keys[i] + 1];
+    }
+    for (std::size_t p = 0; p < num_pins; ++p) {
+      offsets[p + 1] += offsets[p];
+    }
+    rows.resize(num_arcs);
+    std::vector<std::size_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (std::size_t i = 0; i < num_arcs; ++i) {
+      rows[cursor[keys[i]]++] = static_cast<int>(i);
+    }
+  };
+  std::thread rev_thread(
+      [&]() { build_csr(_arc_to, _rev_offsets, _rev_arcs); });
+  build_csr(_arc_from, _fwd_offsets, _fwd_arcs);
+  rev_thread.join();
+
+  // sort forward rows by to pin (stable on arc id) for find()
+  parallel_for(
+      num_pins,
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        for (std::size_t p = begin_idx; p < end_idx; ++p) {
+          auto row_begin = _fwd_arcs.begin() + _fwd_offsets[p];
+          auto row_end = _fwd_arcs.begin() + _fwd_offsets[p + 1];
+          if (row_end - row_begin > 1) {
+            std::stable_sort(row_begin, row_end, [this](int a, int b) {
+              return _arc_to[a] < _arc_to[b];
+            });
+          }
+        }
+      },
+      num_threads);
+  _indexed = true;
+}
+
+void arc_store::restore_index(std::vector<int> arc_from,
+                              std::vector<int> arc_to,
+                              std::vector<std::size_t> fwd_offsets,
+                              std::vector<int> fwd_arcs,
+                              std::vector<std::size_t> rev_offsets,
+                              std::vector<int> rev_arcs,
+                              unsigned int num_threads) {
+  _arc_from = std::move(arc_from);
+  _arc_to = std::move(arc_to);
+  _fwd_offsets = std::move(fwd_offsets);
+  _fwd_arcs = std::move(fwd_arcs);
+  _rev_offsets = std::move(rev_offsets);
+  _rev_arcs = std::move(rev_arcs);
+
+  // pin names are views into the arcs that carry them
+  _pin_names.assign(_fwd_offsets.empty() ? 0 : _fwd_offsets.size() - 1, {});
+  for (std::size_t i = 0; i < _arcs.size(); ++i) {
+    _pin_names[_arc_from[i]] = _arcs[i]->from_pin;
+    _pin_names[_arc_to[i]] = _arcs[i]->to_pin;
+  }
+  build_pin_lookup(num_threads);
+  _indexed = true;
+}
+
+void arc_store::build_pin_lookup(unsigned int num_threads) {
+  const std::size_t num_shards = std::max(1u, num_threads);
+  _pin_shards.assign(num_shards, {});
+  std::vector<uint16_t> pin_shard(_pin_names.size());
+  parallel_for(
+      _pin_names.size(),
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        for (std::size_t p = begin_idx; p < end_idx; ++p) {
+          pin_shard[p] = shard_of(_pin_names[p]);
+        }
+      },
+      num_threads);
+  parallel_for(
+      num_shards,
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        for (std::size_t s = begin_idx; s < end_idx; ++s) {
+          for (std::size_t p = 0; p < _pin_names.size(); ++p) {
+            if (pin_shard[p] == s) {
+              _pin_shards[s].emplace(_pin_names[p], static_cast<int>(p));
+            }
+          }
+        }
+      },
+      num_threads);
+}
+
+int arc_store::pin_id(std::string_view name) const {
+  if (!_indexed) {
+    return -1;
+  }
+  const auto &shard = _pin_shards[shard_of(name)];
+  auto it = shard.find(name);
+  return it == shard.end() ? -1 : it->second;
+}
+
+int arc_store::find(int from_id, int to_id) const {
+  if (from_id < 0 || to_id < 0) {
+    return -1;
+  }
+  auto row = arcs_from(from_id);
+  auto it = std::ranges::upper_bound(row, to_id, {},
+                                     [this](int a) { return _arc_to[a]; });
+  if (it == row.begin() || _arc_to[*std::prev(it)] != to_id) {
+    return -1;
+  }
+  return *std::prev(it);
+}
+
+const std::shared_ptr<Arc> &arc_store::find(std::string_view from,
+                                            std::string_view to) const {
+  int arc_id = find(pin_id(from), pin_id(to));
+  return arc_id < 0 ? _null_arc : _arcs[arc_id];
+}
+
+std::size_t arc_store::retain_between(const std::vector<char> &seed_pins,
+                                      unsigned int num_threads) {
+  const std::size_t num_arcs = _arcs.size();
+  // pins reachable from a seed, and pins a seed is reachable from
+  auto reach = [&](bool forward) {
+    std::vector<char> seen(seed_pins);
+    std::vector<int> stack;
+    for (std::size_t p = 0; p < seen.size(); ++p) {
+      if (seen[p]) {
+        stack.push_back(static_cast<int>(p));
+      }
+    }
+    while (!stack.empty()) {
+      int pin = stack.back();
+      stack.pop_back();
+      for (int arc_id : forward ? arcs_from(pin) : arcs_to(pin)) {
+        int next = forward ? _arc_to[arc_id] : _arc_from[arc_id];
+        if (!seen[next]) {
+          seen[next] = 1;
+          stack.push_back(next);
+        }
+      }
+    }
+    return seen;
+  };
+  std::vector<char> from_seed = reach(true);
+  std::vector<char> to_seed = reach(false);
+
+  std::size_t kept = 0;
+  for (std::size_t a = 0; a < num_arcs; ++a) {
+    if (from_seed[_arc_from[a]] && to_seed[_arc_to[a]]) {
+      _arcs[kept++] = std::move(_arcs[a]);
+    }
+  }
+  _arcs.resize(kept);
+  _arcs.shrink_to_fit();
+  build_index(num_threads);
+  return num_arcs - kept;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <absl/container/flat_hash_map.h>
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "utils/parallel.h"
+
+class Arc;
+
+// arc_store owns every arc of a db and indexes them by interned pin ids.
+// Arc ids are positions in all(); pin ids are dense in [0, num_pins()).
+// After build_index() the forward (by from pin) and reverse (by to pin)
+// adjacency are kept as CSR arrays, forward rows sorted by to pin so that a
+// (from, to) lookup is a binary search inside one row.
+class arc_store {
+ public:
+  void add(const std::shared_ptr<Arc> &arc) {
+    _arcs.push_back(arc);
+    _indexed = false;
+  }
+  void reserve(std::size_t num_arcs) { _arcs.reserve(num_arcs); }
+
+  // intern pins and build the forward/reverse CSR, must be called after all
+  // arcs are added and before any of the lookups below
+  void build_index(unsigned int num_threads = default_num_threads());
+  // adopt an index built earlier for the same arcs in the same order,
+  // only the pin name lookup is rebuilt
+  void restore_index(std::vector<int> arc_from, std::vector<int> arc_to,
+                     std::vector<std::size_t> fwd_offsets,
+                     std::vector<int> fwd_arcs,
+                     std::vector<std::size_t> rev_offsets,
+                     std::vector<int> rev_arcs,
+                     unsigned int num_threads = default_num_threads());
+  bool indexed() const { return _indexed; }
+  // keep only the arcs on some path from one seed pin to another and
+  // re-index, returns the number of arcs dropped
+  std::size_t retain_between(const std::vector<char> &seed_pins,
+                             unsigned int num_threads = default_num_threads());
+
+  const std::vector<std::shared_ptr<Arc>> &all() const { return _arcs; }
+  std::size_t size() const { return _arcs.size(); }
+  bool empty() const { return _arcs.empty(); }
+  const std::shared_ptr<Arc> &arc(int arc_id) const { return _arcs[arc_id]; }
+
+  std::size_t num_pins() const { return _pin_names.size(); }
+  // -1 if the pin is not on any arc
+  int pin_id(std::string_view name) const;
+  std::string_view pin_name(int pin_id) const { return _pin_names[pin_id]; }
+  int from_id(int arc_id) const { return _arc_from[arc_id]; }
+  int to_id(int arc_id) const { return _arc_to[arc_id]; }
+
+  // arc ids leaving / entering a pin
+  std::span<const int> arcs_from(int pin_id) const {
+    return {_fwd_arcs.data() + _fwd_offsets[pin_id],
+            _fwd_arcs.data() + _fwd_offsets[pin_id + 1]};
+  }
+  std::span<const int> arcs_to(int pin_id) const {
+    return {_rev_arcs.data() + _rev_offsets[pin_id],
+            _rev_arcs.data() + _rev_offsets[pin_id + 1]};
+  }
+
+  // raw index arrays, used by the snapshot writer
+  const std::vector<int> &from_ids() const { return _arc_from; }
+  const std::vector<int> &to_ids() const { return _arc_to; }
+  const std::vector<std::size_t> &fwd_offsets() const { return _fwd_offsets; }
+  const std::vector<int> &fwd_arcs() const { return _fwd_arcs; }
+  const std::vector<std::size_t> &rev_offsets() const { return _rev_offsets; }
+  const std::vector<int> &rev_arcs() const { return _rev_arcs; }
+
+  // arc id from -> to, -1 if absent; the last added arc wins on duplicates
+  int find(int from_id, int to_id) const;
+  const std::shared_ptr<Arc> &find(std::string_view from,
+                                   std::string_view to) const;
+
+ private:
+  std::size_t shard_of(std::string_view name) const;
+  void build_pin_lookup(unsigned int num_threads);
+
+ private:
+  std::vector<std::shared_ptr<Arc>> _arcs;
+  bool _indexed = false;
+
+  // pin name -> pin id, sharded by hash so shards are filled in parallel
+  std::vector<absl::flat_hash_map<std::string_view, int>> _pin_shards;
+  std::vector<std::string_view> _pin_names;  // views into the owning arcs
+
+  std::vector<int> _arc_from;  // arc id -> from pin id
+  std::vector<int> _arc_to;    // arc id -> to pin id
+
+  std::vector<std::size_t> _fwd_offsets;  // pin id -> row in _fwd_arcs
+  std::vector<int> _fwd_arcs;
+  std::vector<std::size_t> _rev_offsets;  // pin id -> row in _rev_arcs
+  std::vector<int> _rev_arcs;
+
+  static inline const std::shared_ptr<Arc> _null_arc = nullptr;
+};
@@ -1,8 +1,14 @@
 #include "dm/dm.h"
 
+#include <absl/container/flat_hash_set.h>
+#include <fmt/color.h>
+
 #include <cstdlib>
 #include <fstream>
+#include <string_view>
+#include <thread>
 
+#include "utils/parallel.h"
 #include "utils/utils.h"
 #include "yyjson.h"
 
@@ -49,6 +55,9 @@ nlohmann::json Net::to_json() {
       {"fanout", fanout},
       {"cap", cap},
   };
+  if (hpwl.has_value()) {
+    node["hpwl"] = hpwl.value();
+  }
   return node;
 }
 
@@ -133,20 +142,141 @@ double Path::get_net_delay_pct() {
 }
 
 void basedb::update_loc_from_map(
-    const absl::flat_hash_map<std::string, std::pair<double, double>>
-        &loc_map) {
+    const absl::flat_hash_map<std::string, std::pair<double, double>> &loc_map,
+    unsigned int num_threads) {
+  // every worker resolves an instance once through its cache of instance
+  // name views, occurrences of it in later paths only hash the view
+  parallel_for(
+      paths.size(),
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        absl::flat_hash_map<std::string_view, const std::pair<double, double> *>
+            inst_locs;
+        std::string name_buf;
+        for (std::size_t i = begin_idx; i < end_idx; ++i) {
+          for (const auto &pin : paths[i]->path) {
+            std::string_view name = pin->name;
+            std::size_t slash = name.rfind('/');
+            if (slash == std::string_view::npos) {
+              continue;  // top level port
+            }
+            auto [it, inserted] =
+                inst_locs.try_emplace(name.substr(0, slash), nullptr);
+            if (inserted) {
+              name_buf.assign(it->first);
+              if (auto loc = loc_map.find(name_buf); loc != loc_map.end()) {
+                it->second = &loc->second;
+              }
+            }
+            if (it->second != nullptr) {
+              pin->location = *it->second;
+            }
+          }
+        }
+      },
+      num_threads);
+}
+
+void basedb::update_nets(net_store def_nets, unsigned int num_threads) {
+  nets = std::move(def_nets);
+  nets.build_index();
+  std::vector<Net *> path_nets;
+  absl::flat_hash_set<const Net *> seen;
   for (const auto &path : paths) {
     for (const auto &pin : path->path) {
-      std::size_t pos = pin->name.find_last_of('/');
-      if (pos == std::string::npos) {
-        continue;
+      if (pin->net.has_value() && seen.insert(pin->net->get()).second) {
+        path_nets.push_back(pin->net->get());
       }
-      std::string cell_name = pin->name.substr(0, pos);
-      if (loc_map.contains(cell_name)) {
-        pin->location = loc_map.at(cell_name);
+    }
+  }
+  parallel_for(
+      path_nets.size(),
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        for (std::size_t i = begin_idx; i < end_idx; ++i) {
+          int net_id = nets.net_id(path_nets[i]->name);
+          path_nets[i]->hpwl = nets.hpwl(net_id);
+          path_nets[i]->bbox = nets.bbox(net_id);
+        }
+      },
+      num_threads);
+}
+
+void basedb::build_hierarchy() {
+  hierarchy.clear();
+  for (const auto &path : paths) {
+    for (const auto &pin : path->path) {
+      hierarchy.insert(pin->name);
+    }
+  }
+  for (const auto &[name, _] : pins) {
+    hierarchy.insert(name);
+  }
+  if (arcs.indexed()) {
+    for (std::size_t p = 0; p < arcs.num_pins(); ++p) {
+      hierarchy.insert(arcs.pin_name(p));
+    }
+  }
+}
+
+std::size_t basedb::retain_between(const std::vector<const basedb *> &key_dbs,
+                                   unsigned int num_threads) {
+  if (!arcs.indexed()) {
+    arcs.build_index(num_threads);
+  }
+  // the endpoints of the key arcs are what the value graph is queried with
+  std::vector<char> seeds(arcs.num_pins(), 0);
+  for (const basedb *key_db : key_dbs) {
+    const auto &key_arcs = key_db->arcs.all();
+    std::vector<int> ids(key_arcs.size() * 2, -1);
+    parallel_for(
+        key_arcs.size(),
+        [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+          for (std::size_t i = begin_idx; i < end_idx; ++i) {
+            ids[2 * i] = arcs.pin_id(key_arcs[i]->from_pin);
+            ids[2 * i + 1] = arcs.pin_id(key_arcs[i]->to_pin);
+          }
+        },
+        num_threads);
+    for (int id : ids) {
+      if (id >= 0) {
+        seeds[id] = 1;
       }
     }
   }
+  std::size_t dropped = arcs.retain_between(seeds, num_threads);
+  std::erase_if(pins, [&](const auto &item) {
+    return arcs.pin_id(item.first) < 0;
+  });
+  return dropped;
+}
+
+void basedb::build_spatial_index(unsigned int num_threads) {
+  if (hierarchy.empty()) {
+    build_hierarchy();
+  }
+  std::vector<char> seen(hierarchy.size(), 0);
+  std::vector<std::pair<double, double>> points;
+  std::vector<int> ids;
+  auto add = [&](const Pin &pin) {
+    // unplaced pins sit at the origin, they would all match a window there
+    if (pin.location == std::make_pair(0., 0.)) {
+      return;
+    }
+    int node = hierarchy.find(pin.name);
+    if (node >= 0 && !seen[node]) {
+      seen[node] = 1;
+      points.push_back(pin.location);
+      ids.push_back(node);
+    }
+  };
+  for (const auto &[_, pin] : pins) {
+    add(*pin);
+  }
+  for (const auto &path : paths) {
+    for (const auto &pin : path->path) {
+      add(*pin);
+    }
+  }
+  pin_grid.build(points, ids, num_threads);
 }
 
 void basedb::serialize_to_json(const std::string &output_path) const {
@@ -223,66 +353,213 @@ yyjson_mut_val *pin_to_yyjson(yyjson_mut_doc *doc,
 
   return obj;
 }
-}  // namespace
 
-void basedb::serialize_to_yyjson(const std::string &output_path) const {
-  yyjson_mut_doc *doc = yyjson_mut_doc_new(NULL);
-  yyjson_mut_val *root = yyjson_mut_obj(doc);
-  yyjson_mut_doc_set_root(doc, root);
+yyjson_mut_val *path_to_yyjson(yyjson_mut_doc *doc,
+                               const std::shared_ptr<Path> &path) {
+  yyjson_mut_val *path_node = yyjson_mut_obj(doc);
+  yyjson_mut_obj_add_str(doc, path_node, "clock", path->clock.c_str());
+  yyjson_mut_obj_add_real(doc, path_node, "slack", path->slack);
 
-  yyjson_mut_obj_add_str(doc, root, "design", design.c_str());
-  yyjson_mut_obj_add_str(doc, root, "type", type.c_str());
+  yyjson_mut_val *path_params_obj = yyjson_mut_obj(doc);
+  yyjson_mut_obj_add_val(doc, path_node, "path_params", path_params_obj);
+  for (const auto &[key, value] : path->path_params) {
+    yyjson_mut_obj_add_real(doc, path_params_obj, key.c_str(), value);
+  }
 
-  yyjson_mut_val *paths_arr = yyjson_mut_arr(doc);
-  yyjson_mut_obj_add_val(doc, root, "paths", paths_arr);
+  yyjson_mut_obj_add_str(doc, path_node, "path_group", path->group.c_str());
+  yyjson_mut_obj_add_real(doc, path_node, "length", path->get_length());
+  yyjson_mut_obj_add_real(doc, path_node, "detour", path->get_detour());
+  yyjson_mut_obj_add_real(doc, path_node, "cell_delay_pct",
+                          path->get_cell_delay_pct());
+  yyjson_mut_obj_add_real(doc, path_node, "net_delay_pct",
+                          path->get_net_delay_pct());
 
-  for (const auto &path : paths) {
-    yyjson_mut_val *path_node = yyjson_mut_obj(doc);
-    yyjson_mut_arr_append(paths_arr, path_node);
+  yyjson_mut_val *pin_arr = yyjson_mut_arr(doc);
+  yyjson_mut_obj_add_val(doc, path_node, "path", pin_arr);
 
-    yyjson_mut_obj_add_str(doc, path_node, "clock", path->clock.c_str());
-    yyjson_mut_obj_add_real(doc, path_node, "slack", path->slack);
+  for (const auto &pin : path->path) {
+    yyjson_mut_val *pin_obj = pin_to_yyjson(doc, pin);
+    yyjson_mut_arr_append(pin_arr, pin_obj);
 
-    yyjson_mut_val *path_params_obj = yyjson_mut_obj(doc);
-    yyjson_mut_obj_add_val(doc, path_node, "path_params", path_params_obj);
-    for (const auto &[key, value] : path->path_params) {
-      yyjson_mut_obj_add_real(doc, path_params_obj, key.c_str(), value);
+    if (pin->is_input && pin->net.has_value()) {
+      yyjson_mut_val *net_obj = net_to_yyjson(doc, pin->net.value());
+      yyjson_mut_obj_add_val(doc, pin_obj, "net", net_obj);
     }
+  }
 
-    yyjson_mut_obj_add_str(doc, path_node, "path_group", path->group.c_str());
-    yyjson_mut_obj_add_real(doc, path_node, "length", path->get_length());
-    yyjson_mut_obj_add_real(doc, path_node, "detour", path->get_detour());
-    yyjson_mut_obj_add_real(doc, path_node, "cell_delay_pct",
-                            path->get_cell_delay_pct());
-    yyjson_mut_obj_add_real(doc, path_node, "net_delay_pct",
-                            path->get_net_delay_pct());
-
-    yyjson_mut_val *pin_arr = yyjson_mut_arr(doc);
-    yyjson_mut_obj_add_val(doc, path_node, "path", pin_arr);
+  yyjson_mut_obj_add_str(doc, path_node, "startpoint",
+                         path->startpoint.c_str());
+  yyjson_mut_obj_add_str(doc, path_node, "endpoint", path->endpoint.c_str());
+  return path_node;
+}
 
-    for (const auto &pin : path->path) {
-      yyjson_mut_val *pin_obj = pin_to_yyjson(doc, pin);
-      yyjson_mut_arr_append(pin_arr, pin_obj);
+// the root object up to and including the opening bracket of "paths"
+std::string yyjson_header(const std::string &design, const std::string &type,
+                          bool pretty) {
+  yyjson_mut_doc *doc = yyjson_mut_doc_new(NULL);
+  yyjson_mut_val *root = yyjson_mut_obj(doc);
+  yyjson_mut_doc_set_root(doc, root);
+  yyjson_mut_obj_add_str(doc, root, "design", design.c_str());
+  yyjson_mut_obj_add_str(doc, root, "type", type.c_str());
+  std::size_t len = 0;
+  char *json = yyjson_mut_write_opts(
+      doc, pretty ? YYJSON_WRITE_PRETTY : YYJSON_WRITE_NOFLAG, NULL, &len,
+      NULL);
+  std::string header;
+  if (json) {
+    header.assign(json, len);
+    free(json);
+  }
+  yyjson_mut_doc_free(doc);
+  // drop the closing brace (and the newline before it when pretty)
+  if (auto pos = header.find_last_of('}'); pos != std::string::npos) {
+    header.resize(pos);
+  }
+  if (pretty) {
+    header.resize(header.find_last_not_of('\n') + 1);
+    header += ",\n    \"paths\": [";
+  } else {
+    header += ",\"paths\":[";
+  }
+  return header;
+}
 
-      if (pin->is_input && pin->net.has_value()) {
-        yyjson_mut_val *net_obj = net_to_yyjson(doc, pin->net.value());
-        yyjson_mut_obj_add_val(doc, pin_obj, "net", net_obj);
+// paths of a chunk that could not be written, with the first reason
+struct yyjson_failures {
+  std::size_t count = 0;
+  std::size_t first_path = 0;
+  std::string first_error;
+};
+
+// render paths [begin_idx, end_idx) as comma separated array elements, the
+// separator before the chunk is left to the writer; pretty output is
+// indented to sit inside root.paths
+void yyjson_paths(const std::vector<std::shared_ptr<Path>> &paths,
+                  std::size_t begin_idx, std::size_t end_idx, bool pretty,
+                  std::string &out, yyjson_failures &failures) {
+  constexpr std::string_view indent = "\n        ";
+  out.clear();
+  failures = {};
+  yyjson_mut_doc *doc = yyjson_mut_doc_new(NULL);
+  for (std::size_t i = begin_idx; i < end_idx; ++i) {
+    yyjson_mut_val *path_node = path_to_yyjson(doc, paths[i]);
+    std::size_t len = 0;
+    yyjson_write_err err;
+    char *json = yyjson_mut_val_write_opts(
+        path_node, pretty ? YYJSON_WRITE_PRETTY : YYJSON_WRITE_NOFLAG, NULL,
+        &len, &err);
+    if (!json) {
+      if (failures.count++ == 0) {
+        failures.first_path = i;
+        failures.first_error = err.msg;
       }
+      continue;
     }
-
-    yyjson_mut_obj_add_str(doc, path_node, "startpoint",
-                           path->startpoint.c_str());
-    yyjson_mut_obj_add_str(doc, path_node, "endpoint", path->endpoint.c_str());
+    if (!out.empty()) {
+      out += ',';
+    }
+    if (!pretty) {
+      out.append(json, len);
+    } else {
+      // json strings never hold a raw newline, so every one is a line break
+      std::string_view text(json, len);
+      out += indent;
+      for (std::size_t pos = 0; pos < text.size();) {
+        std::size_t line_end = std::min(text.find('\n', pos), text.size());
+        out += text.substr(pos, line_end - pos);
+        if (line_end < text.size()) {
+          out += indent;
+        }
+        pos = line_end + 1;
+      }
+    }
+    free(json);
   }
+  yyjson_mut_doc_free(doc);
+}
+}  // namespace
 
-  yyjson_write_err err;
-  const char *json =
-      yyjson_mut_write_opts(doc, YYJSON_WRITE_PRETTY, NULL, NULL, &err);
-  if (json) {
-    std::ofstream ofs(output_path);
-    ofs << json;
-    free((void *)json);
+void basedb::serialize_to_yyjson(const std::string &output_path, bool pretty,
+                                 unsigned int num_threads) const {
+  std::ofstream ofs(output_path, std::ios::binary);
+  if (!ofs) {
+    fmt::print("Cannot open {}\n", output_path);
+    return;
+  }
+  ofs << yyjson_header(design, type, pretty);
+
+  // chunks of about _yyjson_chunk_pins pins, rendered num_threads at a time
+  // while the previous round is being written
+  std::vector<std::size_t> chunk_begins = {0};
+  std::size_t chunk_pins = 0;
+  for (std::size_t i = 0; i < paths.size(); ++i) {
+    if (chunk_pins >= _yyjson_chunk_pins) {
+      chunk_begins.push_back(i);
+      chunk_pins = 0;
+    }
+    chunk_pins += paths[i]->path.size() + 1;
+  }
+  chunk_begins.push_back(paths.size());
+  const std::size_t num_chunks = chunk_begins.size() - 1;
+  num_threads = std::max(1u, num_threads);
+
+  std::vector<std::string> buffers(2 * num_threads);
+  std::vector<yyjson_failures> failures(num_chunks);
+  // whether a path is written yet, only touched by the writer thread
+  bool emitted = false;
+  std::thread writer;
+  for (std::size_t round_begin = 0, round = 0; round_begin < num_chunks;
+       round_begin += num_threads, ++round) {
+    const std::size_t round_size =
+        std::min<std::size_t>(num_threads, num_chunks - round_begin);
+    std::string *round_buffers = &buffers[(round % 2) * num_threads];
+    parallel_for(
+        round_size,
+        [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+          for (std::size_t c = begin_idx; c < end_idx; ++c) {
+            yyjson_paths(paths, chunk_begins[round_begin + c],
+                         chunk_begins[round_begin + c + 1], pretty,
+                         round_buffers[c], failures[round_begin + c]);
+          }
+        },
+        num_threads);
+    if (writer.joinable()) {
+      writer.join();
+    }
+    writer = std::thread([&ofs, &emitted, round_buffers, round_size]() {
+      for (std::size_t c = 0; c < round_size; ++c) {
+        if (round_buffers[c].empty()) {
+          continue;
+        }
+        if (emitted) {
+          ofs.put(',');
+        }
+        ofs.write(round_buffers[c].data(), round_buffers[c].size());
+        emitted = true;
+      }
+    });
+  }
+  if (writer.joinable()) {
+    writer.join();
+  }
+  if (!pretty) {
+    ofs << "]}";
+  } else {
+    ofs << (emitted ? "\n    ]\n}" : "]\n}");
   }
 
-  yyjson_mut_doc_free(doc);
+  std::size_t dropped = 0;
+  const yyjson_failures *first = nullptr;
+  for (const auto &chunk : failures) {
+    dropped += chunk.count;
+    if (first == nullptr && chunk.count > 0) {
+      first = &chunk;
+    }
+  }
+  if (first != nullptr) {
+    fmt::print(fmt::fg(fmt::color::red),
+               "Dropped {} of {} paths from {}, path {} ({}): {}\n", dropped,
+               paths.size(), output_path, first->first_path,
+               paths[first->first_path]->endpoint, first->first_error);
+  }
 }
@@ -10,6 +10,10 @@
 #include <utility>
 #include <vector>
 
+#include "dm/arc_store.h"
+#include "dm/hier_trie.h"
+#include "dm/net_store.h"
+#include "dm/spatial_grid.h"
 #include "re2/re2.h"
 #include "yaml-cpp/yaml.h"
 
@@ -62,6 +66,8 @@ class Net {
   int fanout;
   double cap;
   std::pair<std::shared_ptr<Pin>, std::shared_ptr<Pin>> pins;
+  std::optional<double> hpwl;  // from the placed pins of the def net
+  std::optional<net_store::box> bbox;
 
  public:
   nlohmann::json to_json();
@@ -80,26 +86,6 @@ class Arc {
   // nlohmann::json to_json();  // 转换为JSON格式
 };
 
-// Custom Hash for pair<string_view, string_view>
-struct ArcKeyHash {
-  std::size_t operator()(
-      const std::pair<std::string_view, std::string_view>& k) const {
-    // Combine hashes of the two strings
-    // 0x9e3779b9 is a standard magic number (phi) to scramble bits and avoid collisions
-    std::size_t h1 = std::hash<std::string_view>{}(k.first);
-    std::size_t h2 = std::hash<std::string_view>{}(k.second);
-    return h1 ^ (h2 + 0x9e3779b9 + (h1 << 6) + (h1 >> 2));
-  }
-};
-
-// Define the Map Type to save typing
-using ArcMap = std::unordered_map<
-    std::pair<std::string_view,
-              std::string_view>,  // The Key: lightweight pointers
-    std::shared_ptr<Arc>,         // The Value: keeps the strings alive
-    ArcKeyHash                    // The Hasher
-    >;
-
 class Path {
  public:
   std::string startpoint;
@@ -129,52 +115,49 @@ class Path {
 
 class basedb {
  public:
+  // give every path pin the location of its instance in loc_map
   void update_loc_from_map(
       const absl::flat_hash_map<std::string, std::pair<double, double>>&
-          loc_map);
-  void add_arc(bool is_cell_arc, const std::shared_ptr<Arc>& arc) {
-    if (is_cell_arc) {
-      // cell_arcs_rev[arc->to_pin][arc->from_pin] = arc;
-      // cell_arcs[arc->from_pin][arc->to_pin] = arc;
-
-      // Construct the key using views into the string data ALREADY inside 'arc'
-      // No new memory allocation occurs for these keys.
-      std::pair<std::string_view, std::string_view> fwd_key = {arc->from_pin,
-                                                               arc->to_pin};
-      cell_arcs_flat[fwd_key] = arc;
-    } else {
-      // net_arcs[arc->from_pin][arc->to_pin] = arc;
-      std::pair<std::string_view, std::string_view> fwd_key = {arc->from_pin,
-                                                               arc->to_pin};
-      net_arcs_flat[fwd_key] = arc;
-    }
-    all_arcs.push_back(arc);
-  }
+          loc_map,
+      unsigned int num_threads = default_num_threads());
+  // keep the def nets and give every path net its def HPWL and bbox
+  void update_nets(net_store def_nets,
+                   unsigned int num_threads = default_num_threads());
+  // (re)build hierarchy from the path pins, pins and arc endpoints
+  void build_hierarchy();
+  // grid of the located pins by hierarchy node; csv pin records take
+  // precedence over path pins of the same name
+  void build_spatial_index(unsigned int num_threads = default_num_threads());
+  void add_arc(const std::shared_ptr<Arc>& arc) { arcs.add(arc); }
+  // semi-join against the dbs this one is compared with: keep the arcs
+  // between their pins and the pin records those arcs touch, returns the
+  // number of arcs dropped
+  std::size_t retain_between(const std::vector<const basedb*>& key_dbs,
+                             unsigned int num_threads = default_num_threads());
 
   void serialize_to_json(const std::string& output_path) const;
-  void serialize_to_yyjson(const std::string& output_path) const;
+  // paths are rendered in chunks on num_threads workers and streamed out in
+  // order, so memory stays bounded by a few chunks
+  void serialize_to_yyjson(
+      const std::string& output_path, bool pretty = true,
+      unsigned int num_threads = default_num_threads()) const;
 
  public:
   std::vector<std::shared_ptr<Path>> paths;
 
   // csv attributes
-  std::unordered_map<std::string,
-                     std::unordered_map<std::string, std::shared_ptr<Arc>>>
-      cell_arcs;
-  std::unordered_map<std::string,
-                     std::unordered_map<std::string, std::shared_ptr<Arc>>>
-      cell_arcs_rev;
-  std::unordered_map<std::string,
-                     std::unordered_map<std::string, std::shared_ptr<Arc>>>
-      net_arcs;
-  ArcMap cell_arcs_flat;
-  ArcMap net_arcs_flat;
+  arc_store arcs;
   std::unordered_map<std::string, std::shared_ptr<Pin>> pins;
-  std::vector<std::shared_ptr<Arc>> all_arcs;
 
   std::string type;
   std::string design;
   absl::flat_hash_map<std::string, std::string> type_map;
+  hier_trie hierarchy;
+  net_store nets;  // def connectivity, empty without a def
+  spatial_grid pin_grid;
+
+ private:
+  static constexpr std::size_t _yyjson_chunk_pins = 1 << 16;
 };
 
 namespace dm {
@@ -0,0 +1,123 @@
+#include "dm/hier_trie.h"
+
+#include <algorithm>
+
+hier_trie::hier_trie(const hier_trie &other)
+    : _nodes(other._nodes),
+      _num_names(other._num_names),
+      _segments(other._segments),
+      _children(other._children) {
+  _segment_ids.reserve(_segments.size());
+  for (std::size_t i = 0; i < _segments.size(); ++i) {
+    _segment_ids.emplace(_segments[i], static_cast<int>(i));
+  }
+}
+
+hier_trie &hier_trie::operator=(const hier_trie &other) {
+  if (this != &other) {
+    *this = hier_trie(other);
+  }
+  return *this;
+}
+
+void hier_trie::clear() {
+  _nodes.assign(1, {.parent = -1,
+                    .segment = 0,
+                    .first_child = -1,
+                    .next_sibling = -1,
+                    .is_name = false});
+  _num_names = 0;
+  _segments.clear();
+  _segment_ids.clear();
+  _children.clear();
+  segment_id("");
+}
+
+int hier_trie::segment_id(std::string_view segment) {
+  if (auto it = _segment_ids.find(segment); it != _segment_ids.end()) {
+    return it->second;
+  }
+  int id = static_cast<int>(_segments.size());
+  _segments.emplace_back(segment);
+  _segment_ids.emplace(_segments.back(), id);
+  return id;
+}
+
+int hier_trie::child(int node, std::string_view segment) const {
+  auto seg_it = _segment_ids.find(segment);
+  if (seg_it == _segment_ids.end()) {
+    return -1;
+  }
+  auto it = _children.find({node, seg_it->second});
+  return it == _children.end() ? -1 : it->second;
+}
+
+int hier_trie::insert(std::string_view name) {
+  int node = root;
+  std::size_t pos = 0;
+  while (true) {
+    std::size_t end = std::min(name.find('/', pos), name.size());
+    int seg = segment_id(name.substr(pos, end - pos));
+    auto [it, inserted] =
+        _children.try_emplace({node, seg}, static_cast<int>(_nodes.size()));
+    if (inserted) {
+      _nodes.push_back({.parent = node,
+                        .segment = seg,
+                        .first_child = -1,
+                        .next_sibling = _nodes[node].first_child,
+                        .is_name = false});
+      _nodes[node].first_child = it->second;
+    }
+    node = it->second;
+    if (end == name.size()) {
+      break;
+    }
+    pos = end + 1;
+  }
+  if (!_nodes[node].is_name) {
+    _nodes[node].is_name = true;
+    ++_num_names;
+  }
+  return node;
+}
+
+int hier_trie::find(std::string_view name) const {
+  int node = root;
+  std::size_t pos = 0;
+  while (node >= 0) {
+    std::size_t end = std::min(name.find('/', pos), name.size());
+    node = child(node, name.substr(pos, end - pos));
+    if (end == name.size()) {
+      break;
+    }
+    pos = end + 1;
+  }
+  return node;
+}
+
+std::string hier_trie::name(int node) const {
+  std::vector<int> chain;
+  std::size_t len = 0;
+  for (; node > root; node = parent(node)) {
+    chain.push_back(node);
+    len += segment(node).size() + 1;
+  }
+  std::string full;
+  full.reserve(len);
+  for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+    if (it != chain.rbegin()) {
+      full += '/';
+    }
+    full += segment(*it);
+  }
+  return full;
+}
+
+bool hier_trie::under(int node, int scope) const {
+  for (; node >= 0; node = parent(node)) {
+    if (node == scope) {
+      return true;
+    }
+  }
+  return false;
+}
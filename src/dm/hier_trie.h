@@ -0,0 +1,86 @@
+#pragma once
+#include <absl/container/flat_hash_map.h>
+
+#include <deque>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// hier_trie stores hierarchical names ("u_core/u_alu/U1/A") as a tree of
+// '/' separated segments. Every distinct segment text is kept once, a node
+// is a (parent, segment) pair, so the instance of a pin is its parent node
+// and all names below a hierarchy are one subtree walk. It indexes names
+// for scoping and does not replace them, a lookup walks one segment per
+// level.
+class hier_trie {
+ public:
+  static constexpr int root = 0;
+
+  hier_trie() { clear(); }
+  // segment lookup holds views into _segments, re-point them on copy
+  hier_trie(const hier_trie &other);
+  hier_trie &operator=(const hier_trie &other);
+  hier_trie(hier_trie &&other) = default;
+  hier_trie &operator=(hier_trie &&other) = default;
+  void clear();
+
+  // node of the full name, created along with its hierarchy if needed
+  int insert(std::string_view name);
+  // -1 if the name was never inserted (a hierarchy prefix of an inserted
+  // name is found as well)
+  int find(std::string_view name) const;
+
+  bool empty() const { return _num_names == 0; }
+  std::size_t size() const { return _nodes.size(); }
+  std::size_t num_names() const { return _num_names; }
+
+  int parent(int node) const { return _nodes[node].parent; }
+  // the instance a pin node belongs to, -1 for top level names
+  int instance_of(int node) const {
+    int p = node < 0 ? -1 : parent(node);
+    return p == root ? -1 : p;
+  }
+  std::string_view segment(int node) const {
+    return _segments[_nodes[node].segment];
+  }
+  std::string name(int node) const;
+  // node equals scope or lies below it
+  bool under(int node, int scope) const;
+
+  // func(node) for every inserted name at or below scope
+  template <typename Func>
+  void for_each_name(int scope, Func &&func) const {
+    std::vector<int> stack = {scope};
+    while (!stack.empty()) {
+      int node = stack.back();
+      stack.pop_back();
+      if (_nodes[node].is_name) {
+        func(node);
+      }
+      for (int c = _nodes[node].first_child; c >= 0;
+           c = _nodes[c].next_sibling) {
+        stack.push_back(c);
+      }
+    }
+  }
+
+ private:
+  int segment_id(std::string_view segment);
+  int child(int node, std::string_view segment) const;
+
+ private:
+  struct node {
+    int parent;
+    int segment;
+    int first_child;
+    int next_sibling;
+    bool is_name;
+  };
+  std::vector<node> _nodes;
+  std::size_t _num_names = 0;
+
+  std::deque<std::string> _segments;  // stable storage for the views below
+  absl::flat_hash_map<std::string_view, int> _segment_ids;
+  absl::flat_hash_map<std::pair<int, int>, int> _children;
+};
@@ -0,0 +1,57 @@
+#include "dm/net_store.h"
+
+net_store::net_store(const net_store &other)
+    : _names(other._names),
+      _offsets(other._offsets),
+      _pins(other._pins),
+      _boxes(other._boxes) {
+  if (!other._ids.empty()) {
+    build_index();
+  }
+}
+
+net_store &net_store::operator=(const net_store &other) {
+  if (this != &other) {
+    *this = net_store(other);
+  }
+  return *this;
+}
+
+int net_store::add_net(std::string name) {
+  _names.push_back(std::move(name));
+  _offsets.push_back(_offsets.back());
+  return static_cast<int>(_names.size()) - 1;
+}
+
+void net_store::append(net_store &&other) {
+  const std::size_t base = _pins.size();
+  _names.insert(_names.end(), std::make_move_iterator(other._names.begin()),
+                std::make_move_iterator(other._names.end()));
+  for (std::size_t n = 1; n < other._offsets.size(); ++n) {
+    _offsets.push_back(base + other._offsets[n]);
+  }
+  _pins.insert(_pins.end(), std::make_move_iterator(other._pins.begin()),
+               std::make_move_iterator(other._pins.end()));
+  _boxes.clear();
+  _ids.clear();
+  other = net_store();
+}
+
+void net_store::reserve(std::size_t num_nets, std::size_t num_pins) {
+  _names.reserve(num_nets);
+  _offsets.reserve(num_nets + 1);
+  _pins.reserve(num_pins);
+}
+
+void net_store::build_index() {
+  _ids.clear();
+  _ids.reserve(_names.size());
+  for (std::size_t n = 0; n < _names.size(); ++n) {
+    _ids.emplace(_names[n], static_cast<int>(n));
+  }
+}
+
+int net_store::net_id(std::string_view name) const {
+  auto it = _ids.find(name);
+  return it == _ids.end() ? -1 : it->second;
+}
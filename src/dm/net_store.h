@@ -0,0 +1,97 @@
+#pragma once
+#include <absl/container/flat_hash_map.h>
+
+#include <array>
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "utils/parallel.h"
+
+// net_store keeps the connectivity of a DEF as a CSR of net -> pin names
+// ("inst/pin" for component pins, the bare name for io pins) and, once
+// compute_boxes() ran, the bounding box and HPWL of every net.
+class net_store {
+ public:
+  using box = std::array<double, 4>;  // llx, lly, urx, ury
+
+  net_store() = default;
+  // the name lookup holds views into _names, rebuild it on copy
+  net_store(const net_store &other);
+  net_store &operator=(const net_store &other);
+  net_store(net_store &&other) = default;
+  net_store &operator=(net_store &&other) = default;
+
+  // pins added afterwards belong to this net
+  int add_net(std::string name);
+  void add_pin(std::string pin) {
+    _pins.push_back(std::move(pin));
+    ++_offsets.back();
+  }
+  // move the nets of other behind the ones already stored
+  void append(net_store &&other);
+  void reserve(std::size_t num_nets, std::size_t num_pins);
+  // name lookup, must be called after all nets are added
+  void build_index();
+
+  std::size_t size() const { return _names.size(); }
+  bool empty() const { return _names.empty(); }
+  std::size_t num_pins() const { return _pins.size(); }
+  // -1 if there is no such net
+  int net_id(std::string_view name) const;
+  std::string_view name(int net) const { return _names[net]; }
+  std::span<const std::string> pins(int net) const {
+    return {_pins.data() + _offsets[net], _pins.data() + _offsets[net + 1]};
+  }
+
+  // location(pin_name) returns a pointer to the pin location or nullptr,
+  // nets without any located pin get no box
+  template <typename Func>
+  void compute_boxes(Func &&location,
+                     unsigned int num_threads = default_num_threads()) {
+    constexpr double inf = std::numeric_limits<double>::infinity();
+    _boxes.assign(size(), {inf, inf, -inf, -inf});
+    parallel_for(
+        size(),
+        [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+          for (std::size_t n = begin_idx; n < end_idx; ++n) {
+            auto &b = _boxes[n];
+            for (const auto &pin : pins(n)) {
+              if (const std::pair<double, double> *loc = location(pin)) {
+                b[0] = std::min(b[0], loc->first);
+                b[1] = std::min(b[1], loc->second);
+                b[2] = std::max(b[2], loc->first);
+                b[3] = std::max(b[3], loc->second);
+              }
+            }
+          }
+        },
+        num_threads);
+  }
+  std::optional<box> bbox(int net) const {
+    if (net < 0 || static_cast<std::size_t>(net) >= _boxes.size() ||
+        _boxes[net][0] > _boxes[net][2]) {
+      return std::nullopt;
+    }
+    return _boxes[net];
+  }
+  std::optional<double> hpwl(int net) const {
+    auto b = bbox(net);
+    if (!b) {
+      return std::nullopt;
+    }
+    return (*b)[2] - (*b)[0] + (*b)[3] - (*b)[1];
+  }
+
+ private:
+  std::vector<std::string> _names;
+  std::vector<std::size_t> _offsets = {0};  // net id -> first pin in _pins
+  std::vector<std::string> _pins;
+  std::vector<box> _boxes;
+  absl::flat_hash_map<std::string_view, int> _ids;  // views into _names
+};
@@ -0,0 +1,49 @@
+#include "dm/pin_join.h"
+
+namespace {
+const Pin *find_record(
+    const std::unordered_map<std::string, std::shared_ptr<Pin>> &records,
+    std::string &name_buf, std::string_view name) {
+  if (records.empty()) {
+    return nullptr;
+  }
+  name_buf.assign(name);
+  auto it = records.find(name_buf);
+  return it == records.end() ? nullptr : it->second.get();
+}
+}  // namespace
+
+void pin_join::build(const basedb &key_db, const basedb &value_db,
+                     unsigned int num_threads) {
+  const auto &key_arcs = key_db.arcs;
+  const auto &value_arcs = value_db.arcs;
+  _key_has_records = !key_db.pins.empty();
+  _value_has_records = !value_db.pins.empty();
+  _value_pins.assign(key_arcs.num_pins(), -1);
+  _key_records.assign(key_arcs.num_pins(), nullptr);
+  _key_value_records.assign(key_arcs.num_pins(), nullptr);
+  _value_records.assign(value_arcs.num_pins(), nullptr);
+
+  parallel_for(
+      key_arcs.num_pins(),
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        std::string name_buf;
+        for (std::size_t p = begin_idx; p < end_idx; ++p) {
+          std::string_view name = key_arcs.pin_name(p);
+          _value_pins[p] = value_arcs.pin_id(name);
+          _key_records[p] = find_record(key_db.pins, name_buf, name);
+          _key_value_records[p] = find_record(value_db.pins, name_buf, name);
+        }
+      },
+      num_threads);
+  parallel_for(
+      value_arcs.num_pins(),
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        std::string name_buf;
+        for (std::size_t p = begin_idx; p < end_idx; ++p) {
+          _value_records[p] =
+              find_record(value_db.pins, name_buf, value_arcs.pin_name(p));
+        }
+      },
+      num_threads);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>
+
+#include "dm/dm.h"
+#include "utils/parallel.h"
+
+// pin_join resolves, once per (key, value) db pair, every pin of the key
+// db's arc_store to its pin id in the value db's arc_store and to the Pin
+// records (the AT csv rows) of both dbs, so that per-arc code only indexes
+// arrays. Both arc stores must be indexed.
+class pin_join {
+ public:
+  void build(const basedb &key_db, const basedb &value_db,
+             unsigned int num_threads = default_num_threads());
+
+  // -1 if the key pin has no arc in the value db
+  int value_pin(int key_pin) const { return _value_pins[key_pin]; }
+  // nullptr if the db has no record for the pin
+  const Pin *key_record(int key_pin) const { return _key_records[key_pin]; }
+  const Pin *value_record(int key_pin) const {
+    return _key_value_records[key_pin];
+  }
+  // record of a value db pin, e.g. a pin inside a value path
+  const Pin *value_pin_record(int value_pin) const {
+    return value_pin < 0 ? nullptr : _value_records[value_pin];
+  }
+
+  bool key_has_records() const { return _key_has_records; }
+  bool value_has_records() const { return _value_has_records; }
+
+ private:
+  // by key pin id
+  std::vector<int> _value_pins;
+  std::vector<const Pin *> _key_records;
+  std::vector<const Pin *> _key_value_records;
+  // by value pin id
+  std::vector<const Pin *> _value_records;
+  bool _key_has_records = false;
+  bool _value_has_records = false;
+};
@@ -0,0 +1,718 @@
+#include "dm/snapshot.h"
+
+#include <absl/container/flat_hash_map.h>
+#include <fmt/color.h>
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <ranges>
+#include <span>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+#include "utils/parallel.h"
+
+namespace snapshot {
+namespace {
+constexpr std::array<char, 8> file_magic = {'S', 'L', 'K', 'S',
+                                            'N', 'A', 'P', '\0'};
+constexpr uint32_t npos = UINT32_MAX;
+static_assert(sizeof(std::size_t) == sizeof(uint64_t));
+
+enum section_id : uint32_t {
+  Strings,     // uint64_t offsets into the blob, num strings + 1
+  StringBlob,  // char
+  Paths,
+  PathPins,  // uint32_t pin index
+  PathParams,
+  Pins,
+  Nets,
+  Arcs,
+  ArcFrom,  // arc_store index arrays, empty if the db was not indexed
+  ArcTo,
+  FwdOffsets,
+  FwdArcs,
+  RevOffsets,
+  RevArcs,
+  DbPins,   // basedb::pins, key -> pin index
+  TypeMap,  // key -> string id
+  Sources,  // kind -> canonical path
+  NumSections,
+};
+
+struct section {
+  uint64_t offset;
+  uint64_t count;
+};
+
+struct file_header {
+  std::array<char, 8> magic;
+  uint32_t version;
+  uint32_t num_sections;
+  uint32_t design;
+  uint32_t type;
+  std::array<section, NumSections> sections;
+};
+
+struct path_rec {
+  uint32_t startpoint;
+  uint32_t endpoint;
+  uint32_t group;
+  uint32_t clock;
+  double slack;
+  uint64_t pin_begin;  // range in PathPins
+  uint64_t pin_end;
+  uint64_t param_begin;  // range in PathParams
+  uint64_t param_end;
+};
+
+struct param_rec {
+  uint32_t key;
+  uint32_t pad;
+  double value;
+};
+
+// which optional fields of a pin_rec are set
+enum pin_flag : uint32_t {
+  HasCell = 1u << 0,
+  HasInstance = 1u << 1,
+  HasTrans = 1u << 2,
+  HasTranss = 1u << 3,
+  HasIncrDelay = 1u << 4,
+  HasPathDelay = 1u << 5,
+  HasPathDelays = 1u << 6,
+  HasPtaBuf = 1u << 7,
+  HasPtaNet = 1u << 8,
+  HasRiseFall = 1u << 9,
+  RiseFall = 1u << 10,
+  IsInput = 1u << 11,
+  HasCap = 1u << 12,
+  HasCaps = 1u << 13,
+  HasPathSlack = 1u << 14,
+  HasPathSlacks = 1u << 15,
+};
+
+struct pin_rec {
+  uint32_t name;
+  uint32_t cell;
+  uint32_t instance;
+  uint32_t type;
+  uint32_t net;  // npos if the pin has no net
+  uint32_t flags;
+  double trans;
+  std::array<double, 2> transs;
+  double incr_delay;
+  double path_delay;
+  std::array<double, 2> path_delays;
+  double pta_buf;
+  double pta_net;
+  std::array<double, 2> location;
+  double cap;
+  std::array<double, 2> caps;
+  double path_slack;
+  std::array<double, 2> path_slacks;
+};
+
+struct net_rec {
+  uint32_t name;
+  int32_t fanout;
+  double cap;
+  uint32_t first_pin;  // npos if unset
+  uint32_t second_pin;
+};
+
+struct arc_rec {
+  uint32_t from_pin;
+  uint32_t to_pin;
+  uint32_t type;
+  uint32_t has_fanout;
+  int32_t fanout;
+  uint32_t pad;
+  std::array<double, 2> delay;
+};
+
+struct key_rec {
+  uint32_t key;
+  uint32_t value;
+};
+
+class string_table {
+ public:
+  string_table() { id(""); }
+  // views must stay valid until the table is written
+  uint32_t id(std::string_view str) {
+    auto [it, inserted] =
+        _ids.try_emplace(str, static_cast<uint32_t>(_offsets.size() - 1));
+    if (inserted) {
+      _blob.append(str);
+      _offsets.push_back(_blob.size());
+    }
+    return it->second;
+  }
+  const std::vector<uint64_t> &offsets() const { return _offsets; }
+  const std::string &blob() const { return _blob; }
+
+ private:
+  absl::flat_hash_map<std::string_view, uint32_t> _ids;
+  std::vector<uint64_t> _offsets = {0};
+  std::string _blob;
+};
+
+template <typename T>
+T flag_value(const std::optional<T> &value, uint32_t &flags, uint32_t bit) {
+  if (!value.has_value()) {
+    return T{};
+  }
+  flags |= bit;
+  return value.value();
+}
+
+template <typename T>
+void restore_value(std::optional<T> &value, uint32_t flags, uint32_t bit,
+                   const T &stored) {
+  if (flags & bit) {
+    value = stored;
+  }
+}
+
+class reader {
+ public:
+  reader(const char *data, std::size_t size) : _data(data), _size(size) {
+    if (_size < sizeof(file_header)) {
+      _ok = false;
+      return;
+    }
+    std::memcpy(&_header, _data, sizeof(file_header));
+    _ok = _header.magic == file_magic && _header.version == version &&
+          _header.num_sections == NumSections;
+    if (!_ok) {
+      return;
+    }
+    _offsets = get<uint64_t>(Strings);
+    _blob = get<char>(StringBlob);
+    _ok = _ok && !_offsets.empty() && _offsets.back() <= _blob.size() &&
+          std::ranges::is_sorted(_offsets);
+  }
+
+  bool ok() const { return _ok && !_bad_ref; }
+  const file_header &header() const { return _header; }
+
+  template <typename T>
+  std::span<const T> get(section_id id) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    const auto &sec = _header.sections[id];
+    if (sec.offset % alignof(T) != 0 || sec.offset > _size ||
+        sec.count > (_size - sec.offset) / sizeof(T)) {
+      _ok = false;
+      return {};
+    }
+    return {reinterpret_cast<const T *>(_data + sec.offset), sec.count};
+  }
+
+  // safe to call from worker threads, a bad id is remembered and yields ""
+  std::string_view str(uint32_t id) const {
+    if (id + 1 >= _offsets.size()) {
+      _bad_ref = true;
+      return {};
+    }
+    return {_blob.data() + _offsets[id], _offsets[id + 1] - _offsets[id]};
+  }
+  // checks an index into a section of the given size
+  bool check(uint64_t idx, std::size_t size) const {
+    if (idx >= size) {
+      _bad_ref = true;
+      return false;
+    }
+    return true;
+  }
+
+ private:
+  const char *_data;
+  std::size_t _size;
+  file_header _header{};
+  bool _ok = true;
+  mutable std::atomic<bool> _bad_ref = false;
+  std::span<const uint64_t> _offsets;
+  std::span<const char> _blob;
+};
+
+// All objects of a loaded db live in one allocation. The handles stored in
+// the basedb own the arena through aliasing; links between objects inside it
+// (path -> pin, pin <-> net) do not, otherwise it could never be released.
+struct arena {
+  std::vector<Path> paths;
+  std::vector<Pin> pins;
+  std::vector<Net> nets;
+  std::vector<Arc> arcs;
+};
+
+std::string canonical(const std::string &path) {
+  std::error_code ec;
+  auto canonical_path = std::filesystem::weakly_canonical(path, ec);
+  return ec ? path : canonical_path.string();
+}
+
+template <typename T>
+std::shared_ptr<T> link(T &obj) {
+  return std::shared_ptr<T>(std::shared_ptr<void>(), &obj);
+}
+}  // namespace
+
+bool write(const basedb &db, const std::string &output_path,
+           const std::vector<source> &sources) {
+  string_table strings;
+  absl::flat_hash_map<const Pin *, uint32_t> pin_ids;
+  absl::flat_hash_map<const Net *, uint32_t> net_ids;
+  std::vector<const Pin *> pins;
+  std::vector<const Net *> nets;
+  auto add_pin = [&](const std::shared_ptr<Pin> &pin) -> uint32_t {
+    if (!pin) {
+      return npos;
+    }
+    auto [it, inserted] =
+        pin_ids.try_emplace(pin.get(), static_cast<uint32_t>(pins.size()));
+    if (inserted) {
+      pins.push_back(pin.get());
+    }
+    return it->second;
+  };
+
+  std::vector<path_rec> path_recs;
+  std::vector<uint32_t> path_pins;
+  std::vector<param_rec> param_recs;
+  path_recs.reserve(db.paths.size());
+  for (const auto &path : db.paths) {
+    path_rec rec{
+        .startpoint = strings.id(path->startpoint),
+        .endpoint = strings.id(path->endpoint),
+        .group = strings.id(path->group),
+        .clock = strings.id(path->clock),
+        .slack = path->slack,
+        .pin_begin = path_pins.size(),
+        .pin_end = 0,
+        .param_begin = param_recs.size(),
+        .param_end = 0,
+    };
+    for (const auto &pin : path->path) {
+      path_pins.push_back(add_pin(pin));
+    }
+    for (const auto &[key, value] : path->path_params) {
+      param_recs.push_back({.key = strings.id(key), .pad = 0, .value = value});
+    }
+    rec.pin_end = path_pins.size();
+    rec.param_end = param_recs.size();
+    path_recs.push_back(rec);
+  }
+
+  std::vector<key_rec> db_pins;
+  db_pins.reserve(db.pins.size());
+  for (const auto &[key, pin] : db.pins) {
+    db_pins.push_back({.key = strings.id(key), .value = add_pin(pin)});
+  }
+
+  // nets hanging off the pins, and the pins hanging off those nets
+  for (std::size_t i = 0; i < pins.size(); ++i) {
+    const Pin *pin = pins[i];
+    if (!pin->net.has_value() || !pin->net.value()) {
+      continue;
+    }
+    const auto &net = pin->net.value();
+    auto [it, inserted] =
+        net_ids.try_emplace(net.get(), static_cast<uint32_t>(nets.size()));
+    if (inserted) {
+      nets.push_back(net.get());
+      add_pin(net->pins.first);
+      add_pin(net->pins.second);
+    }
+  }
+
+  std::vector<pin_rec> pin_recs(pins.size());
+  for (std::size_t i = 0; i < pins.size(); ++i) {
+    const Pin &pin = *pins[i];
+    pin_rec &rec = pin_recs[i];
+    rec.name = strings.id(pin.name);
+    if (pin.cell.has_value()) {
+      rec.flags |= HasCell;
+      rec.cell = strings.id(pin.cell.value());
+    }
+    if (pin.instance.has_value()) {
+      rec.flags |= HasInstance;
+      rec.instance = strings.id(pin.instance.value());
+    }
+    rec.type = strings.id(pin.type);
+    rec.net = pin.net.has_value() && pin.net.value()
+                  ? net_ids.at(pin.net.value().get())
+                  : npos;
+    rec.trans = flag_value(pin.trans, rec.flags, HasTrans);
+    rec.transs = flag_value(pin.transs, rec.flags, HasTranss);
+    rec.incr_delay = flag_value(pin.incr_delay, rec.flags, HasIncrDelay);
+    rec.path_delay = flag_value(pin.path_delay, rec.flags, HasPathDelay);
+    rec.path_delays = flag_value(pin.path_delays, rec.flags, HasPathDelays);
+    rec.pta_buf = flag_value(pin.pta_buf, rec.flags, HasPtaBuf);
+    rec.pta_net = flag_value(pin.pta_net, rec.flags, HasPtaNet);
+    if (flag_value(pin.rise_fall, rec.flags, HasRiseFall)) {
+      rec.flags |= RiseFall;
+    }
+    if (pin.is_input) {
+      rec.flags |= IsInput;
+    }
+    rec.location = {pin.location.first, pin.location.second};
+    rec.cap = flag_value(pin.cap, rec.flags, HasCap);
+    rec.caps = flag_value(pin.caps, rec.flags, HasCaps);
+    rec.path_slack = flag_value(pin.path_slack, rec.flags, HasPathSlack);
+    rec.path_slacks = flag_value(pin.path_slacks, rec.flags, HasPathSlacks);
+  }
+
+  std::vector<net_rec> net_recs;
+  net_recs.reserve(nets.size());
+  for (const Net *net : nets) {
+    net_recs.push_back({
+        .name = strings.id(net->name),
+        .fanout = net->fanout,
+        .cap = net->cap,
+        .first_pin = net->pins.first ? pin_ids.at(net->pins.first.get()) : npos,
+        .second_pin =
+            net->pins.second ? pin_ids.at(net->pins.second.get()) : npos,
+    });
+  }
+
+  std::vector<arc_rec> arc_recs;
+  arc_recs.reserve(db.arcs.size());
+  for (const auto &arc : db.arcs.all()) {
+    arc_recs.push_back({
+        .from_pin = strings.id(arc->from_pin),
+        .to_pin = strings.id(arc->to_pin),
+        .type = static_cast<uint32_t>(arc->type),
+        .has_fanout = arc->fanout.has_value(),
+        .fanout = arc->fanout.value_or(0),
+        .pad = 0,
+        .delay = arc->delay,
+    });
+  }
+
+  std::vector<key_rec> type_map;
+  type_map.reserve(db.type_map.size());
+  for (const auto &[key, value] : db.type_map) {
+    type_map.push_back({.key = strings.id(key), .value = strings.id(value)});
+  }
+
+  std::vector<std::string> source_paths;
+  source_paths.reserve(sources.size());
+  for (const auto &src : sources) {
+    source_paths.push_back(canonical(src.path));
+  }
+  std::vector<key_rec> source_recs;
+  source_recs.reserve(sources.size());
+  for (std::size_t i = 0; i < sources.size(); ++i) {
+    source_recs.push_back({.key = strings.id(sources[i].kind),
+                           .value = strings.id(source_paths[i])});
+  }
+
+  file_header header{};
+  header.magic = file_magic;
+  header.version = version;
+  header.num_sections = NumSections;
+  header.design = strings.id(db.design);
+  header.type = strings.id(db.type);
+
+  // write next to the target and rename, a reader never sees a partial file
+  std::string tmp_path = output_path + ".tmp";
+  std::ofstream ofs(tmp_path, std::ios::binary);
+  if (!ofs) {
+    fmt::print(fmt::fg(fmt::color::red), "Cannot open snapshot file {}\n",
+               tmp_path);
+    return false;
+  }
+  ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  auto put = [&](section_id id, const auto &records) {
+    using T = std::ranges::range_value_t<decltype(records)>;
+    static_assert(std::is_trivially_copyable_v<T>);
+    static constexpr std::array<char, 8> padding{};
+    auto pos = static_cast<uint64_t>(ofs.tellp());
+    ofs.write(padding.data(), (8 - pos % 8) % 8);
+    header.sections[id] = {.offset = static_cast<uint64_t>(ofs.tellp()),
+                           .count = records.size()};
+    ofs.write(reinterpret_cast<const char *>(records.data()),
+              records.size() * sizeof(T));
+  };
+  put(Paths, path_recs);
+  put(PathPins, path_pins);
+  put(PathParams, param_recs);
+  put(Pins, pin_recs);
+  put(Nets, net_recs);
+  put(Arcs, arc_recs);
+  if (db.arcs.indexed()) {
+    put(ArcFrom, db.arcs.from_ids());
+    put(ArcTo, db.arcs.to_ids());
+    put(FwdOffsets, db.arcs.fwd_offsets());
+    put(FwdArcs, db.arcs.fwd_arcs());
+    put(RevOffsets, db.arcs.rev_offsets());
+    put(RevArcs, db.arcs.rev_arcs());
+  }
+  put(DbPins, db_pins);
+  put(TypeMap, type_map);
+  put(Sources, source_recs);
+  put(Strings, strings.offsets());
+  put(StringBlob, strings.blob());
+  ofs.seekp(0);
+  ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  ofs.close();
+  if (!ofs) {
+    fmt::print(fmt::fg(fmt::color::red), "Cannot write snapshot file {}\n",
+               tmp_path);
+    return false;
+  }
+  std::error_code ec;
+  std::filesystem::rename(tmp_path, output_path, ec);
+  if (ec) {
+    fmt::print(fmt::fg(fmt::color::red), "Cannot move snapshot to {}, {}\n",
+               output_path, ec.message());
+    return false;
+  }
+  return true;
+}
+
+std::shared_ptr<basedb> load(const std::string &snapshot_path,
+                             std::vector<source> *sources) {
+  boost::iostreams::mapped_file_source file;
+  try {
+    file.open(snapshot_path);
+  } catch (const std::exception &err) {
+    fmt::print(fmt::fg(fmt::color::red), "Cannot map snapshot {}, {}\n",
+               snapshot_path, err.what());
+    return nullptr;
+  }
+  reader rd(file.data(), file.size());
+  auto path_recs = rd.get<path_rec>(Paths);
+  auto path_pins = rd.get<uint32_t>(PathPins);
+  auto param_recs = rd.get<param_rec>(PathParams);
+  auto pin_recs = rd.get<pin_rec>(Pins);
+  auto net_recs = rd.get<net_rec>(Nets);
+  auto arc_recs = rd.get<arc_rec>(Arcs);
+  auto db_pins = rd.get<key_rec>(DbPins);
+  auto type_map = rd.get<key_rec>(TypeMap);
+  auto source_recs = rd.get<key_rec>(Sources);
+  if (!rd.ok()) {
+    fmt::print(fmt::fg(fmt::color::red),
+               "Snapshot {} is damaged or of another version\n",
+               snapshot_path);
+    return nullptr;
+  }
+
+  auto store = std::make_shared<arena>();
+  store->paths.resize(path_recs.size());
+  store->pins.resize(pin_recs.size());
+  store->nets.resize(net_recs.size());
+  store->arcs.resize(arc_recs.size());
+  auto owned = [&store](auto &obj) {
+    using T = std::remove_reference_t<decltype(obj)>;
+    return std::shared_ptr<T>(store, &obj);
+  };
+
+  parallel_for(pin_recs.size(), [&](unsigned int, std::size_t begin_idx,
+                                    std::size_t end_idx) {
+    for (std::size_t i = begin_idx; i < end_idx; ++i) {
+      const pin_rec &rec = pin_recs[i];
+      Pin &pin = store->pins[i];
+      pin.name = rd.str(rec.name);
+      if (rec.flags & HasCell) {
+        pin.cell = std::string(rd.str(rec.cell));
+      }
+      if (rec.flags & HasInstance) {
+        pin.instance = std::string(rd.str(rec.instance));
+      }
+      restore_value(pin.trans, rec.flags, HasTrans, rec.trans);
+      restore_value(pin.transs, rec.flags, HasTranss, rec.transs);
+      restore_value(pin.incr_delay, rec.flags, HasIncrDelay, rec.incr_delay);
+      restore_value(pin.path_delay, rec.flags, HasPathDelay, rec.path_delay);
+      restore_value(pin.path_delays, rec.flags, HasPathDelays,
+                    rec.path_delays);
+      restore_value(pin.pta_buf, rec.flags, HasPtaBuf, rec.pta_buf);
+      restore_value(pin.pta_net, rec.flags, HasPtaNet, rec.pta_net);
+      restore_value(pin.rise_fall, rec.flags, HasRiseFall,
+                    (rec.flags & RiseFall) != 0);
+      pin.is_input = rec.flags & IsInput;
+      pin.location = {rec.location[0], rec.location[1]};
+      if (rec.net != npos && rd.check(rec.net, store->nets.size())) {
+        pin.net = link(store->nets[rec.net]);
+      }
+      restore_value(pin.cap, rec.flags, HasCap, rec.cap);
+      restore_value(pin.caps, rec.flags, HasCaps, rec.caps);
+      restore_value(pin.path_slack, rec.flags, HasPathSlack, rec.path_slack);
+      restore_value(pin.path_slacks, rec.flags, HasPathSlacks,
+                    rec.path_slacks);
+      pin.type = rd.str(rec.type);
+    }
+  });
+
+  parallel_for(net_recs.size(), [&](unsigned int, std::size_t begin_idx,
+                                    std::size_t end_idx) {
+    auto pin_at = [&](uint32_t idx) -> std::shared_ptr<Pin> {
+      if (idx == npos || !rd.check(idx, store->pins.size())) {
+        return nullptr;
+      }
+      return link(store->pins[idx]);
+    };
+    for (std::size_t i = begin_idx; i < end_idx; ++i) {
+      const net_rec &rec = net_recs[i];
+      Net &net = store->nets[i];
+      net.name = rd.str(rec.name);
+      net.fanout = rec.fanout;
+      net.cap = rec.cap;
+      net.pins = {pin_at(rec.first_pin), pin_at(rec.second_pin)};
+    }
+  });
+
+  parallel_for(path_recs.size(), [&](unsigned int, std::size_t begin_idx,
+                                     std::size_t end_idx) {
+    for (std::size_t i = begin_idx; i < end_idx; ++i) {
+      const path_rec &rec = path_recs[i];
+      Path &path = store->paths[i];
+      path.startpoint = rd.str(rec.startpoint);
+      path.endpoint = rd.str(rec.endpoint);
+      path.group = rd.str(rec.group);
+      path.clock = rd.str(rec.clock);
+      path.slack = rec.slack;
+      if (rec.pin_begin > rec.pin_end ||
+          !rd.check(rec.pin_end, path_pins.size() + 1) ||
+          rec.param_begin > rec.param_end ||
+          !rd.check(rec.param_end, param_recs.size() + 1)) {
+        continue;
+      }
+      for (const auto &param : param_recs.subspan(
+               rec.param_begin, rec.param_end - rec.param_begin)) {
+        path.path_params.emplace(rd.str(param.key), param.value);
+      }
+      path.path.reserve(rec.pin_end - rec.pin_begin);
+      for (uint32_t pin_idx :
+           path_pins.subspan(rec.pin_begin, rec.pin_end - rec.pin_begin)) {
+        if (rd.check(pin_idx, store->pins.size())) {
+          path.path.push_back(link(store->pins[pin_idx]));
+        }
+      }
+    }
+  });
+
+  parallel_for(arc_recs.size(), [&](unsigned int, std::size_t begin_idx,
+                                    std::size_t end_idx) {
+    for (std::size_t i = begin_idx; i < end_idx; ++i) {
+      const arc_rec &rec = arc_recs[i];
+      Arc &arc = store->arcs[i];
+      rd.check(rec.type, static_cast<uint32_t>(arc_type::PairArc) + 1);
+      arc.type = static_cast<arc_type>(rec.type);
+      arc.from_pin = rd.str(rec.from_pin);
+      arc.to_pin = rd.str(rec.to_pin);
+      arc.delay = rec.delay;
+      if (rec.has_fanout) {
+        arc.fanout = rec.fanout;
+      }
+    }
+  });
+
+  auto db = std::make_shared<basedb>();
+  db->design = rd.str(rd.header().design);
+  db->type = rd.str(rd.header().type);
+  db->paths.reserve(store->paths.size());
+  for (auto &path : store->paths) {
+    db->paths.push_back(owned(path));
+  }
+  db->pins.reserve(db_pins.size());
+  for (const auto &rec : db_pins) {
+    if (rd.check(rec.value, store->pins.size())) {
+      db->pins[std::string(rd.str(rec.key))] = owned(store->pins[rec.value]);
+    }
+  }
+  for (const auto &rec : type_map) {
+    db->type_map[std::string(rd.str(rec.key))] = rd.str(rec.value);
+  }
+  if (sources != nullptr) {
+    sources->clear();
+    for (const auto &rec : source_recs) {
+      sources->push_back(
+          {std::string(rd.str(rec.key)), std::string(rd.str(rec.value))});
+    }
+  }
+
+  db->arcs.reserve(store->arcs.size());
+  for (auto &arc : store->arcs) {
+    db->add_arc(owned(arc));
+  }
+  auto arc_from = rd.get<int>(ArcFrom);
+  auto arc_to = rd.get<int>(ArcTo);
+  auto fwd_offsets = rd.get<std::size_t>(FwdOffsets);
+  auto fwd_arcs = rd.get<int>(FwdArcs);
+  auto rev_offsets = rd.get<std::size_t>(RevOffsets);
+  auto rev_arcs = rd.get<int>(RevArcs);
+  if (!rd.ok()) {
+    fmt::print(fmt::fg(fmt::color::red), "Snapshot {} is damaged\n",
+               snapshot_path);
+    return nullptr;
+  }
+  const std::size_t num_arcs = store->arcs.size();
+  bool has_index =
+      !fwd_offsets.empty() && fwd_offsets.size() == rev_offsets.size() &&
+      arc_from.size() == num_arcs && arc_to.size() == num_arcs &&
+      fwd_arcs.size() == num_arcs && rev_arcs.size() == num_arcs &&
+      fwd_offsets.back() == num_arcs && rev_offsets.back() == num_arcs &&
+      std::ranges::is_sorted(fwd_offsets) &&
+      std::ranges::is_sorted(rev_offsets);
+  auto in_range = [](auto ids, std::size_t size) {
+    return std::ranges::all_of(ids, [size](int id) {
+      return id >= 0 && static_cast<std::size_t>(id) < size;
+    });
+  };
+  has_index = has_index &&
+              in_range(arc_from, fwd_offsets.size() - 1) &&
+              in_range(arc_to, fwd_offsets.size() - 1) &&
+              in_range(fwd_arcs, num_arcs) && in_range(rev_arcs, num_arcs);
+  if (has_index) {
+    auto to_vector = [](auto records) {
+      return std::vector<std::ranges::range_value_t<decltype(records)>>(
+          records.begin(), records.end());
+    };
+    db->arcs.restore_index(to_vector(arc_from), to_vector(arc_to),
+                           to_vector(fwd_offsets), to_vector(fwd_arcs),
+                           to_vector(rev_offsets), to_vector(rev_arcs));
+  } else if (!db->arcs.empty()) {
+    db->arcs.build_index();
+  }
+  return db;
+}
+
+std::string default_path(const std::string &source_path) {
+  return source_path + ".snap";
+}
+
+bool is_fresh(const std::string &snapshot_path,
+              const std::vector<source> &sources) {
+  std::error_code ec;
+  auto snapshot_time = std::filesystem::last_write_time(snapshot_path, ec);
+  if (ec) {
+    return false;
+  }
+  return std::ranges::all_of(sources, [&](const source &src) {
+    std::error_code source_ec;
+    auto source_time = std::filesystem::last_write_time(src.path, source_ec);
+    return !source_ec && source_time <= snapshot_time;
+  });
+}
+
+bool same_sources(std::vector<source> stored, std::vector<source> sources) {
+  for (auto &src : sources) {
+    src.path = canonical(src.path);
+  }
+  auto less = [](const source &a, const source &b) {
+    return std::tie(a.kind, a.path) < std::tie(b.kind, b.path);
+  };
+  std::ranges::sort(stored, less);
+  std::ranges::sort(sources, less);
+  return stored == sources;
+}
+}  // namespace snapshot
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "dm/dm.h"
+
+// Binary snapshot of a parsed basedb. The file is a header followed by
+// 8-byte aligned sections of fixed size records (strings are interned into
+// one blob), so loading is a single mmap plus a parallel pass that rebuilds
+// the objects; the arc CSR index is stored as is.
+namespace snapshot {
+constexpr uint32_t version = 2;
+
+// a file the db was parsed from, kind is the yml key naming it (path,
+// cell_csv, net_csv, at_csv)
+struct source {
+  std::string kind;
+  std::string path;
+  bool operator==(const source &) const = default;
+};
+
+// the paths of sources are stored canonical
+bool write(const basedb &db, const std::string &output_path,
+           const std::vector<source> &sources);
+// nullptr if the file is missing, truncated or of another version; the
+// sources it was written from go to sources if given
+std::shared_ptr<basedb> load(const std::string &snapshot_path,
+                             std::vector<source> *sources = nullptr);
+
+// <source>.snap, the place rpt_serial writes to by default
+std::string default_path(const std::string &source_path);
+// the snapshot exists and is not older than any of its sources
+bool is_fresh(const std::string &snapshot_path,
+              const std::vector<source> &sources);
+// both name the same files of the same kinds, in any order
+bool same_sources(std::vector<source> stored, std::vector<source> sources);
+}  // namespace snapshot
@@ -0,0 +1,98 @@
+#include "dm/spatial_grid.h"
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+void spatial_grid::build(const std::vector<std::pair<double, double>> &points,
+                         const std::vector<int> &ids,
+                         unsigned int num_threads) {
+  const std::size_t n = points.size();
+  *this = spatial_grid();
+  if (n == 0) {
+    return;
+  }
+  // per-thread cell histograms cost threads * cells counters, keep that in
+  // the order of the points themselves
+  num_threads = std::clamp<unsigned int>(
+      num_threads, 1, static_cast<unsigned int>(2 * _points_per_cell));
+
+  constexpr double inf = std::numeric_limits<double>::infinity();
+  std::vector<window> local_bounds(num_threads, {inf, inf, -inf, -inf});
+  parallel_for(
+      n,
+      [&](unsigned int t, std::size_t begin_idx, std::size_t end_idx) {
+        auto &b = local_bounds[t];
+        for (std::size_t i = begin_idx; i < end_idx; ++i) {
+          const auto &[x, y] = points[i];
+          b[0] = std::min(b[0], x);
+          b[1] = std::min(b[1], y);
+          b[2] = std::max(b[2], x);
+          b[3] = std::max(b[3], y);
+        }
+      },
+      num_threads);
+  _bounds = {inf, inf, -inf, -inf};
+  for (const auto &b : local_bounds) {
+    _bounds[0] = std::min(_bounds[0], b[0]);
+    _bounds[1] = std::min(_bounds[1], b[1]);
+    _bounds[2] = std::max(_bounds[2], b[2]);
+    _bounds[3] = std::max(_bounds[3], b[3]);
+  }
+
+  // square-ish cells with about _points_per_cell points each
+  const double width = std::max(_bounds[2] - _bounds[0], 1e-9);
+  const double height = std::max(_bounds[3] - _bounds[1], 1e-9);
+  const std::size_t target = std::max<std::size_t>(1, n / _points_per_cell);
+  _nx = static_cast<int>(std::clamp<double>(
+      std::round(std::sqrt(target * width / height)), 1., target));
+  _ny = static_cast<int>(std::clamp<double>(
+      std::ceil(static_cast<double>(target) / _nx), 1., target));
+  _cell_w = width / _nx;
+  _cell_h = height / _ny;
+  const std::size_t num_cells = static_cast<std::size_t>(_nx) * _ny;
+
+  std::vector<std::uint32_t> cells(n);
+  std::vector<std::vector<std::size_t>> counts(num_threads);
+  parallel_for(
+      n,
+      [&](unsigned int t, std::size_t begin_idx, std::size_t end_idx) {
+        counts[t].assign(num_cells, 0);
+        for (std::size_t i = begin_idx; i < end_idx; ++i) {
+          auto [cx, cy] = cell_of(points[i].first, points[i].second);
+          cells[i] = static_cast<std::uint32_t>(cy) * _nx + cx;
+          ++counts[t][cells[i]];
+        }
+      },
+      num_threads);
+
+  // counts[t][c] becomes the slot where thread t writes its next point of c
+  _offsets.assign(num_cells + 1, 0);
+  std::size_t pos = 0;
+  for (std::size_t c = 0; c < num_cells; ++c) {
+    _offsets[c] = pos;
+    for (auto &count : counts) {
+      if (count.empty()) {
+        continue;
+      }
+      std::size_t k = count[c];
+      count[c] = pos;
+      pos += k;
+    }
+  }
+  _offsets[num_cells] = pos;
+
+  _points.resize(n);
+  _ids.resize(n);
+  parallel_for(
+      n,
+      [&](unsigned int t, std::size_t begin_idx, std::size_t end_idx) {
+        auto &slots = counts[t];
+        for (std::size_t i = begin_idx; i < end_idx; ++i) {
+          std::size_t slot = slots[cells[i]]++;
+          _points[slot] = points[i];
+          _ids[slot] = ids[i];
+        }
+      },
+      num_threads);
+}
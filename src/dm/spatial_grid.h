@@ -0,0 +1,69 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "utils/parallel.h"
+
+// spatial_grid buckets points of the die into a uniform grid sized to a few
+// points per cell. Points are stored cell by cell (CSR), so a window query
+// only visits the cells the window overlaps.
+class spatial_grid {
+ public:
+  using window = std::array<double, 4>;  // llx, lly, urx, ury
+
+  // ids[i] is reported for points[i]
+  void build(const std::vector<std::pair<double, double>> &points,
+             const std::vector<int> &ids,
+             unsigned int num_threads = default_num_threads());
+
+  bool empty() const { return _ids.empty(); }
+  std::size_t size() const { return _ids.size(); }
+  const window &bounds() const { return _bounds; }
+
+  // func(id) for every point inside the window, borders included
+  template <typename Func>
+  void query(const window &win, Func &&func) const {
+    if (empty() || win[0] > _bounds[2] || win[2] < _bounds[0] ||
+        win[1] > _bounds[3] || win[3] < _bounds[1]) {
+      return;
+    }
+    auto [cx0, cy0] = cell_of(win[0], win[1]);
+    auto [cx1, cy1] = cell_of(win[2], win[3]);
+    for (int cy = cy0; cy <= cy1; ++cy) {
+      for (int cx = cx0; cx <= cx1; ++cx) {
+        std::size_t cell = static_cast<std::size_t>(cy) * _nx + cx;
+        for (std::size_t i = _offsets[cell]; i < _offsets[cell + 1]; ++i) {
+          const auto &[x, y] = _points[i];
+          if (x >= win[0] && x <= win[2] && y >= win[1] && y <= win[3]) {
+            func(_ids[i]);
+          }
+        }
+      }
+    }
+  }
+
+ private:
+  // cell coordinates, clamped into the grid before the cast so far away or
+  // nan coordinates cannot overflow the int
+  std::pair<int, int> cell_of(double x, double y) const {
+    auto clamp = [](double cell, int n) {
+      return cell > 0. ? static_cast<int>(std::min(cell, n - 1.)) : 0;
+    };
+    return {clamp((x - _bounds[0]) / _cell_w, _nx),
+            clamp((y - _bounds[1]) / _cell_h, _ny)};
+  }
+
+ private:
+  static constexpr std::size_t _points_per_cell = 4;
+  window _bounds = {0., 0., 0., 0.};
+  int _nx = 1;
+  int _ny = 1;
+  double _cell_w = 1.;
+  double _cell_h = 1.;
+  std::vector<std::size_t> _offsets = {0, 0};  // cell -> first point
+  std::vector<std::pair<double, double>> _points;
+  std::vector<int> _ids;
+};
@@ -5,6 +5,8 @@
 #include <fmt/core.h>
 #include <fmt/ranges.h>
 
+#include <thread>
+
 #include "absl/container/flat_hash_set.h"
 #include "analyser/arc_analyser.h"
 #include "analyser/arc_analyser_graph.h"
@@ -15,11 +17,16 @@
 #include "analyser/pair_analyser_csv.h"
 #include "analyser/pair_analyser_graph.h"
 #include "analyser/path_analyser.h"
+#include "analyser/timing_analyser.h"
+#include "analyser/timing_update_analyser.h"
+#include "dm/snapshot.h"
 #include "parser/csv_parser.h"
 #include "parser/def_parser.h"
 #include "parser/invs_rpt.h"
+#include "parser/json_parser.h"
 #include "parser/leda_endpoint.h"
 #include "parser/leda_rpt.h"
+#include "utils/timing_graph.h"
 #include "yaml-cpp/yaml.h"
 
 void flow_control::parse_yml(std::string yml_file) {
@@ -76,6 +83,10 @@ void flow_control::parse_yml(std::string yml_file) {
     _analyser = std::make_unique<pair_analyser_csv>(config["configs"]);
   } else if (mode == "pair analyse graph") {
     _analyser = std::make_unique<pair_analyser_graph>(config["configs"]);
+  } else if (mode == "timing analyse csv") {
+    _analyser = std::make_unique<timing_analyser>(config["configs"]);
+  } else if (mode == "timing update csv") {
+    _analyser = std::make_unique<timing_update_analyser>(config["configs"]);
   } else {
     throw std::system_error(
         errno, std::generic_category(),
@@ -93,53 +104,190 @@ void flow_control::parse_yml(std::string yml_file) {
   auto rpt_node = config["rpts"];
   auto valid_rpts = _analyser->check_valid(rpt_node);
 
-  for (const auto& rpt : valid_rpts) {
+  auto semi_join_pairs = _analyser->semi_join_pairs();
+  for (const auto& [key_rpt, value_rpt] : semi_join_pairs) {
+    _semi_join_keys[value_rpt].push_back(key_rpt);
+  }
+  for (const auto& [key_rpt, _] : semi_join_pairs) {
+    _semi_join_keys.erase(key_rpt);  // a key db is always loaded whole
+  }
+  std::vector<std::string> rpts(valid_rpts.begin(), valid_rpts.end());
+  std::ranges::stable_partition(rpts, [&](const std::string& rpt) {
+    return !_semi_join_keys.contains(rpt);
+  });
+
+  for (const auto& rpt : rpts) {
     run_function(fmt::format("parse rpt {}", rpt),
                  [&]() { parse_rpt(rpt_node[rpt], rpt); });
   }
 }
 
+namespace {
+// a snapshot written for the sources of this rpt, nullptr if there is none,
+// it is older than any source, it was parsed as another type than
+// parser_type or from other files
+std::shared_ptr<basedb> load_fresh_snapshot(
+    const YAML::Node& rpt, const std::vector<snapshot::source>& sources,
+    const std::string& parser_type) {
+  if (rpt["use_snapshot"] && !rpt["use_snapshot"].as<bool>()) {
+    return nullptr;
+  }
+  std::string snapshot_path =
+      rpt["snapshot"] ? rpt["snapshot"].as<std::string>()
+                      : snapshot::default_path(sources.front().path);
+  if (!snapshot::is_fresh(snapshot_path, sources)) {
+    return nullptr;
+  }
+  fmt::print("Loading snapshot {}\n", snapshot_path);
+  std::vector<snapshot::source> stored;
+  auto db = snapshot::load(snapshot_path, &stored);
+  if (db != nullptr && db->type != parser_type) {
+    fmt::print(fmt::fg(fmt::color::yellow),
+               "Warning: snapshot {} holds a {} db, not {}, reparse\n",
+               snapshot_path, db->type.empty() ? "untyped" : db->type,
+               parser_type);
+    return nullptr;
+  }
+  if (db != nullptr && !snapshot::same_sources(stored, sources)) {
+    auto names = [](const std::vector<snapshot::source>& srcs) {
+      std::vector<std::string> parts;
+      for (const auto& src : srcs) {
+        parts.push_back(fmt::format("{} {}", src.kind, src.path));
+      }
+      return fmt::format("{}", fmt::join(parts, ", "));
+    };
+    fmt::print(fmt::fg(fmt::color::yellow),
+               "Warning: snapshot {} was written from {}, not {}, reparse\n",
+               snapshot_path, names(stored), names(sources));
+    return nullptr;
+  }
+  return db;
+}
+
+// the worst_paths worst paths of a csv rpt, at most paths_per_endpoint
+// into each endpoint, enumerated on its arcs and at csv arrivals so the
+// path modes can use it; its paths are replaced
+void enumerate_paths(const YAML::Node& rpt, const std::string& key,
+                     basedb& db) {
+  if (!rpt["worst_paths"]) {
+    return;
+  }
+  if (!rpt["at_csv"]) {
+    fmt::print(fmt::fg(fmt::color::red),
+               "worst_paths of rpt {} needs an at_csv, skip.\n", key);
+    return;
+  }
+  auto max_paths = rpt["worst_paths"].as<std::size_t>();
+  std::size_t paths_per_endpoint = 1;
+  if (rpt["paths_per_endpoint"]) {
+    paths_per_endpoint = rpt["paths_per_endpoint"].as<std::size_t>();
+  }
+  run_function(fmt::format("enumerate paths {}", key), [&]() {
+    timing_graph graph;
+    graph.build_graph(db.arcs.all());
+    graph.propagate(db.pins);
+    db.paths = graph.worst_paths(db, max_paths, paths_per_endpoint);
+    fmt::print("Enumerated {} worst paths of {}\n", db.paths.size(), key);
+  });
+}
+}  // namespace
+
 void flow_control::parse_rpt(const YAML::Node& rpt, std::string key) {
   auto rpt_type = rpt["type"].as<std::string>();
+  if (rpt_type == "snapshot") {
+    auto snapshot_path = rpt["path"].as<std::string>();
+    fmt::print("Loading snapshot {}\n", snapshot_path);
+    auto snapshot_db = snapshot::load(snapshot_path);
+    if (!snapshot_db) {
+      throw std::system_error(
+          errno, std::generic_category(),
+          fmt::format(fmt::fg(fmt::color::red),
+                      "Cannot load snapshot file {}, skip.", snapshot_path));
+    }
+    semi_join(key, snapshot_db.get());
+    std::lock_guard<std::mutex> lock(_dbs_mutex);
+    _dbs[key] = snapshot_db;
+    return;
+  }
+  if (rpt_type == "json") {
+    auto json_path = rpt["path"].as<std::string>();
+    fmt::print("Parsing json file {}\n", json_path);
+    json_parser parser;
+    if (rpt["tool"]) {
+      parser.set_tool(rpt["tool"].as<std::string>());
+    }
+    if (!parser.parse_file(json_path)) {
+      throw std::system_error(
+          errno, std::generic_category(),
+          fmt::format(fmt::fg(fmt::color::red),
+                      "Cannot parse json file {}, skip.", json_path));
+    }
+    auto json_db = std::make_shared<basedb>(std::move(parser._db));
+    semi_join(key, json_db.get());
+    std::lock_guard<std::mutex> lock(_dbs_mutex);
+    _dbs[key] = json_db;
+    return;
+  }
   if (rpt_type == "csv") {
+    std::vector<std::string> sources = {rpt["cell_csv"].as<std::string>(),
+                                        rpt["net_csv"].as<std::string>()};
+    if (rpt["at_csv"]) {
+      sources.push_back(rpt["at_csv"].as<std::string>());
+    }
+    std::vector<snapshot::source> snapshot_sources = {
+        {"cell_csv", sources[0]}, {"net_csv", sources[1]}};
+    if (rpt["at_csv"]) {
+      snapshot_sources.push_back({"at_csv", sources[2]});
+    }
+    if (auto snapshot_db =
+            load_fresh_snapshot(rpt, snapshot_sources, rpt_type)) {
+      snapshot_db->type = rpt_type;
+      semi_join(key, snapshot_db.get());
+      enumerate_paths(rpt, key, *snapshot_db);
+      std::lock_guard<std::mutex> lock(_dbs_mutex);
+      _dbs[key] = snapshot_db;
+      return;
+    }
     auto parser = std::make_shared<csv_parser>();
-    auto cell_csv_path = rpt["cell_csv"].as<std::string>();
-    auto net_csv_path = rpt["net_csv"].as<std::string>();
-    fmt::print("Parsing cell csv file {}\n", cell_csv_path);
-    if (!parser->parse_file(csv_type::CellArc, cell_csv_path)) {
+    std::vector<std::pair<csv_type, std::string>> files = {
+        {csv_type::CellArc, sources[0]},
+        {rpt["at_csv"] ? csv_type::NetArcFanout : csv_type::NetArc,
+         sources[1]}};
+    // semi-joined at csv is read once the arcs are pruned, keeping only the
+    // rows of pins on the remaining arcs
+    bool at_after_join = rpt["at_csv"] && _semi_join_keys.contains(key);
+    if (rpt["at_csv"] && !at_after_join) {
+      files.emplace_back(csv_type::PinAT, sources[2]);
+    }
+    fmt::print("Parsing csv files {}\n", fmt::join(sources, ", "));
+    if (!parser->parse_files(files)) {
       throw std::system_error(
           errno, std::generic_category(),
           fmt::format(fmt::fg(fmt::color::red),
-                      "Cannot parse cell csv file {}, skip.", cell_csv_path));
-      std::exit(1);
+                      "Cannot parse csv files {}, skip.",
+                      fmt::join(sources, ", ")));
     }
-
-    auto parse_net_csv = [&](csv_type type) {
-      fmt::print("Parsing net csv file {}\n", net_csv_path);
-      if (!parser->parse_file(type, net_csv_path)) {
-        throw std::system_error(
-            errno, std::generic_category(),
-            fmt::format(fmt::fg(fmt::color::red),
-                        "Cannot parse net csv file {}, skip.", net_csv_path));
-      }
-    };
-
-    if (rpt["at_csv"]) {
-      parse_net_csv(csv_type::NetArcFanout);
-      auto at_csv_path = rpt["at_csv"].as<std::string>();
-      fmt::print("Parsing pin at csv file {}\n", at_csv_path);
-      if (!parser->parse_file(csv_type::PinAT, at_csv_path)) {
+    auto csv_db = std::make_shared<basedb>(std::move(parser->_db));
+    run_function(fmt::format("index arcs {}", key),
+                 [&]() { csv_db->arcs.build_index(); });
+    semi_join(key, csv_db.get());
+    if (at_after_join) {
+      csv_parser at_parser;
+      at_parser.set_pin_filter([&](std::string_view pin) {
+        return csv_db->arcs.pin_id(pin) >= 0;
+      });
+      if (!at_parser.parse_file(csv_type::PinAT, sources[2])) {
         throw std::system_error(
             errno, std::generic_category(),
             fmt::format(fmt::fg(fmt::color::red),
-                        "Cannot parse pin at csv file {}, skip.", at_csv_path));
+                        "Cannot parse pin at csv file {}, skip.", sources[2]));
       }
-    } else {
-      parse_net_csv(csv_type::NetArc);
+      csv_db->pins = std::move(at_parser._db.pins);
     }
+    enumerate_paths(rpt, key, *csv_db);
     {
       std::lock_guard<std::mutex> lock(_dbs_mutex);
-      _dbs[key] = std::make_shared<basedb>(parser->get_db());
+      _dbs[key] = csv_db;
     }
     return;
   }
@@ -153,11 +301,6 @@ void flow_control::parse_rpt(const YAML::Node& rpt, std::string key) {
     max_paths = rpt["max_paths"].as<std::size_t>();
   }
 
-  std::shared_ptr<basedb> cur_db;
-  fmt::print("Parsing {}\n", rpt_file);
-  std::variant<std::shared_ptr<rpt_parser<std::string>>,
-               std::shared_ptr<rpt_parser<std::string_view>>>
-      parser;
   absl::flat_hash_set<std::string> valid_types = {"leda", "leda_def", "invs",
                                                   "leda_endpoint"};
   if (valid_types.contains(rpt_type) == false) {
@@ -169,6 +312,89 @@ void flow_control::parse_rpt(const YAML::Node& rpt, std::string key) {
     std::exit(1);
   }
 
+  // the def is parsed alongside the report
+  std::shared_ptr<def_parser> def;
+  bool def_valid = false;
+  std::jthread def_thread;
+  if (absl::StrContains(rpt_type, "def")) {
+    def = std::make_shared<def_parser>();
+    def_thread = std::jthread(
+        [&def, &def_valid, def_file = rpt["def"].as<std::string>()]() {
+          def_valid = def->parse_file(def_file);
+        });
+  }
+
+  std::shared_ptr<basedb> cur_db;
+  // a truncated parse is not what the snapshot holds, and rpt_serial only
+  // writes snapshots of leda reports
+  if (!ignore_path && max_paths == 0 &&
+      (rpt_type == "leda" || rpt_type == "leda_def")) {
+    cur_db = load_fresh_snapshot(rpt, {{"path", rpt_file}}, "leda");
+  }
+  if (cur_db) {
+    cur_db->type = rpt_type;
+  } else {
+    cur_db = parse_rpt_file(rpt_file, rpt_type, ignore_path, max_paths);
+  }
+  // def as appendix
+  if (def != nullptr) {
+    def_thread.join();
+    if (def_valid) {
+      run_function(fmt::format("apply def {}", key), [&]() {
+        cur_db->update_loc_from_map(def->get_loc_map());
+        cur_db->update_nets(def->take_nets());
+      });
+    }
+    cur_db->type_map = def->take_type_map();
+  }
+  semi_join(key, cur_db.get());
+  {
+    std::lock_guard<std::mutex> lock(_dbs_mutex);
+    _dbs[key] = cur_db;
+  }
+}
+
+void flow_control::semi_join(const std::string& key, basedb* db) {
+  auto it = _semi_join_keys.find(key);
+  if (it == _semi_join_keys.end()) {
+    return;
+  }
+  if (db == nullptr) {
+    fmt::print(fmt::fg(fmt::color::yellow),
+               "Warning: rpt {} was not loaded, skip semi join\n", key);
+    return;
+  }
+  std::vector<const basedb*> key_dbs;
+  {
+    std::lock_guard<std::mutex> lock(_dbs_mutex);
+    for (const auto& key_rpt : it->second) {
+      auto key_it = _dbs.find(key_rpt);
+      if (key_it == _dbs.end() || key_it->second == nullptr) {
+        // pruning against a missing key would drop arcs it needs
+        fmt::print(fmt::fg(fmt::color::yellow),
+                   "Warning: key rpt {} of {} was not loaded, skip semi "
+                   "join\n",
+                   key_rpt, key);
+        return;
+      }
+      key_dbs.push_back(key_it->second.get());
+    }
+  }
+  run_function(fmt::format("semi join {}", key), [&]() {
+    std::size_t dropped = db->retain_between(key_dbs);
+    fmt::print("Semi join {} with {}: kept {} arcs, dropped {}\n", key,
+               fmt::join(it->second, ", "), db->arcs.size(), dropped);
+  });
+}
+
+std::shared_ptr<basedb> flow_control::parse_rpt_file(
+    const std::string& rpt_file, const std::string& rpt_type,
+    bool ignore_path, std::size_t max_paths) {
+  std::shared_ptr<basedb> cur_db;
+  fmt::print("Parsing {}\n", rpt_file);
+  std::variant<std::shared_ptr<rpt_parser<std::string>>,
+               std::shared_ptr<rpt_parser<std::string_view>>>
+      parser;
   if (rpt_type == "leda_endpoint") {
     parser = std::make_shared<leda_endpoint_parser<std::string_view>>(1);
   } else if (ignore_path) {
@@ -199,18 +425,7 @@ void flow_control::parse_rpt(const YAML::Node& rpt, std::string key) {
         }
       },
       parser);
-  // def as appendix
-  if (absl::StrContains(rpt_type, "def")) {
-    std::shared_ptr<def_parser> parser = std::make_shared<def_parser>();
-    if (parser->parse_file(rpt["def"].as<std::string>())) {
-      cur_db->update_loc_from_map(parser->get_loc_map());
-    }
-    cur_db->type_map = parser->get_type_map();
-  }
-  {
-    std::lock_guard<std::mutex> lock(_dbs_mutex);
-    _dbs[key] = cur_db;
-  }
+  return cur_db;
 }
 
 void flow_control::run() {
@@ -14,6 +14,13 @@ class flow_control {
   void run();
   void parse_yml(std::string yml_file);
   void parse_rpt(const YAML::Node& rpt, std::string key);
+  std::shared_ptr<basedb> parse_rpt_file(const std::string& rpt_file,
+                                         const std::string& rpt_type,
+                                         bool ignore_path,
+                                         std::size_t max_paths);
+  // prune a value db loaded in semi-join mode against its key dbs, skipped
+  // with a warning if it or one of them failed to load
+  void semi_join(const std::string& key, basedb* db);
   // void parse_rpts();
   // void analyse();
   // void parse_rpt_config(const YAML::Node& rpt);
@@ -24,6 +31,8 @@ class flow_control {
   // compare mode
   absl::flat_hash_map<std::string, std::shared_ptr<basedb>> _dbs;
   std::mutex _dbs_mutex;
+  // value rpt -> key rpts it is semi-joined with, keys are loaded first
+  absl::flat_hash_map<std::string, std::vector<std::string>> _semi_join_keys;
   absl::flat_hash_map<std::string,
                       std::vector<std::pair<std::string, std::string>>>
       _rpts;
@@ -1,13 +1,25 @@
 #include "csv_parser.h"
 
+#include <fmt/color.h>
+#include <fmt/core.h>
+
 #include <algorithm>
+#include <boost/iostreams/device/mapped_file.hpp>
 #include <charconv>
+#include <filesystem>
+#include <thread>
 #include <vector>
 
 #include "utils/utils.h"
 
 namespace {
 
+// chunks carry no header row
+using CsvChunkReaderType =
+    csv2::Reader<csv2::delimiter<','>, csv2::quote_character<'"'>,
+                 csv2::first_row_is_header<false>,
+                 csv2::trim_policy::trim_whitespace>;
+
 // Helper to parse numbers using std::from_chars
 template <typename T>
 bool fast_parse(std::string_view sv, T &value) {
@@ -40,212 +52,384 @@ enum class ArcCol {
   Fanout
 };
 
+// end of the row that holds pos; in_quote is the quote state at pos and a
+// newline inside quotes does not end a row
+std::size_t row_end(std::string_view text, std::size_t pos, bool in_quote) {
+  for (; pos < text.size(); ++pos) {
+    if (text[pos] == '"') {
+      in_quote = !in_quote;
+    } else if (text[pos] == '\n' && !in_quote) {
+      return pos + 1;
+    }
+  }
+  return text.size();
+}
+
+// Cut text into about num_chunks pieces at row boundaries. The quote state
+// at every nominal cut comes from the parity of the quotes counted before
+// it, so a quoted field is never split.
+std::vector<std::string_view> split_rows(std::string_view text,
+                                         std::size_t num_chunks,
+                                         unsigned int num_threads) {
+  const std::size_t step = (text.size() + num_chunks - 1) / num_chunks;
+  auto cut = [&](std::size_t c) { return std::min(c * step, text.size()); };
+  std::vector<std::size_t> quotes(num_chunks, 0);
+  parallel_for(
+      num_chunks,
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        for (std::size_t c = begin_idx; c < end_idx; ++c) {
+          quotes[c] = std::count(text.begin() + cut(c),
+                                 text.begin() + cut(c + 1), '"');
+        }
+      },
+      num_threads);
+  std::vector<char> in_quote(num_chunks, 0);
+  for (std::size_t c = 1; c < num_chunks; ++c) {
+    in_quote[c] = in_quote[c - 1] ^ static_cast<char>(quotes[c - 1] & 1);
+  }
+
+  std::vector<std::size_t> begins(num_chunks + 1, text.size());
+  begins[0] = 0;
+  parallel_for(
+      num_chunks,
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        for (std::size_t c = std::max<std::size_t>(begin_idx, 1); c < end_idx;
+             ++c) {
+          begins[c] = row_end(text, cut(c), in_quote[c]);
+        }
+      },
+      num_threads);
+
+  std::vector<std::string_view> chunks;
+  chunks.reserve(num_chunks);
+  for (std::size_t c = 0; c < num_chunks; ++c) {
+    // a long quoted field may carry one cut past the next
+    begins[c + 1] = std::max(begins[c + 1], begins[c]);
+    if (begins[c + 1] > begins[c]) {
+      chunks.push_back(text.substr(begins[c], begins[c + 1] - begins[c]));
+    }
+  }
+  return chunks;
+}
+
+template <typename Col>
+std::vector<Col> map_columns(
+    const std::vector<std::string> &headers,
+    std::initializer_list<std::pair<std::string_view, Col>> names) {
+  std::vector<Col> col_map(headers.size(), Col::Ignore);
+  for (const auto &[name, col_type] : names) {
+    auto it = std::find(headers.begin(), headers.end(), name);
+    if (it != headers.end()) {
+      col_map[it - headers.begin()] = col_type;
+    }
+  }
+  return col_map;
+}
+
+// nullptr if the row is rejected
+template <typename Row>
+std::shared_ptr<Pin> read_pin(
+    const Row &row, const std::vector<PinCol> &col_map,
+    const std::function<bool(std::string_view)> &keep_pin) {
+  const int max_idx = col_map.size();
+  std::string pin_name;
+  double x = 0.0, y = 0.0;
+  double max_rise_slack = 0.0, max_fall_slack = 0.0;
+  double max_rise_cap = 0.0, max_fall_cap = 0.0;
+  double max_rise_trans = 0.0, max_fall_trans = 0.0;
+  double max_rise_at = 0.0, max_fall_at = 0.0;
+
+  bool has_loc_x = false;
+  bool has_loc_y = false;
+  bool row_valid = true;
+
+  int idx = 0;
+  for (const auto &cell : row) {
+    if (idx >= max_idx) {
+      idx++;
+      continue;
+    }
+
+    switch (col_map[idx]) {
+      case PinCol::Pin:
+        pin_name = std::string(cell.read_view());
+        break;
+      case PinCol::LocX:
+        if (fast_parse(cell.read_view(), x)) has_loc_x = true;
+        break;
+      case PinCol::LocY:
+        if (fast_parse(cell.read_view(), y)) has_loc_y = true;
+        break;
+      case PinCol::MaxRiseSlack:
+        if (!fast_parse(cell.read_view(), max_rise_slack)) row_valid = false;
+        break;
+      case PinCol::MaxFallSlack:
+        if (!fast_parse(cell.read_view(), max_fall_slack)) row_valid = false;
+        break;
+      case PinCol::MaxRiseCap:
+        if (!fast_parse(cell.read_view(), max_rise_cap)) row_valid = false;
+        break;
+      case PinCol::MaxFallCap:
+        if (!fast_parse(cell.read_view(), max_fall_cap)) row_valid = false;
+        break;
+      case PinCol::MaxRiseTrans:
+        if (!fast_parse(cell.read_view(), max_rise_trans)) row_valid = false;
+        break;
+      case PinCol::MaxFallTrans:
+        if (!fast_parse(cell.read_view(), max_fall_trans)) row_valid = false;
+        break;
+      case PinCol::MaxRiseAt:
+        if (!fast_parse(cell.read_view(), max_rise_at)) row_valid = false;
+        break;
+      case PinCol::MaxFallAt:
+        if (!fast_parse(cell.read_view(), max_fall_at)) row_valid = false;
+        break;
+      default:
+        break;
+    }
+    idx++;
+  }
+
+  if (!has_loc_x || !has_loc_y || !row_valid || pin_name.empty()) {
+    return nullptr;
+  }
+  if (keep_pin && !keep_pin(pin_name)) {
+    return nullptr;
+  }
+
+  double path_slack = std::min(max_rise_slack, max_fall_slack);
+  return std::make_shared<Pin>(Pin{
+      .name = std::move(pin_name),
+      .transs = std::array<double, 2>{max_rise_trans, max_fall_trans},
+      .path_delays = std::array<double, 2>{max_rise_at, max_fall_at},
+      .location = {x, y},
+      .caps = std::array<double, 2>{max_rise_cap, max_fall_cap},
+      .path_slack = path_slack,
+      .path_slacks = std::array<double, 2>{max_rise_slack, max_fall_slack},
+  });
+}
+
+// nullptr if the row is rejected
+template <typename Row>
+std::shared_ptr<Arc> read_arc(const Row &row,
+                              const std::vector<ArcCol> &col_map,
+                              csv_type type) {
+  const int max_idx = col_map.size();
+  std::string from_pin, to_pin;
+  double setup_delay_rise = 0.0;
+  double setup_delay_fall = 0.0;
+  int fanout_val = 0;
+  bool row_valid = true;
+
+  int idx = 0;
+  for (const auto &cell : row) {
+    if (idx >= max_idx) {
+      idx++;
+      continue;
+    }
+
+    switch (col_map[idx]) {
+      case ArcCol::FromPin:
+        from_pin = std::string(cell.read_view());
+        break;
+      case ArcCol::ToPin:
+        to_pin = std::string(cell.read_view());
+        break;
+      case ArcCol::SetupDelayRise:
+        if (!fast_parse(cell.read_view(), setup_delay_rise)) row_valid = false;
+        break;
+      case ArcCol::SetupDelayFall:
+        if (!fast_parse(cell.read_view(), setup_delay_fall)) row_valid = false;
+        break;
+      case ArcCol::Fanout:
+        if (!fast_parse(cell.read_view(), fanout_val)) row_valid = false;
+        break;
+      default:
+        break;
+    }
+    idx++;
+  }
+
+  if (!row_valid || from_pin.empty() || to_pin.empty()) {
+    return nullptr;
+  }
+
+  if (setup_delay_rise > 1e5 || setup_delay_fall > 1e5) {
+    return nullptr;
+  }
+
+  std::optional<int> fanout;
+  if (type == csv_type::NetArcFanout) {
+    fanout = fanout_val;
+  }
+
+  return std::make_shared<Arc>(
+      Arc{.type = type == csv_type::CellArc ? arc_type::CellArc
+                                            : arc_type::NetArc,
+          .from_pin = std::move(from_pin),
+          .to_pin = std::move(to_pin),
+          .delay = {setup_delay_rise, setup_delay_fall},
+          .fanout = fanout});
+}
+
 }  // namespace
 
 bool csv_parser::parse_file(csv_type type, const std::string &filename) {
-  CsvReaderType csv;
-
-  if (!csv.mmap(filename)) {
+  csv_rows rows;
+  if (!read_file(type, filename, rows, _num_threads)) {
     return false;
   }
+  merge(rows);
+  return true;
+}
 
-  std::vector<std::string> headers;
-  for (const auto &cell : csv.header()) {
-    headers.push_back(std::string(cell.read_view()));
+bool csv_parser::parse_files(
+    const std::vector<std::pair<csv_type, std::string>> &files) {
+  std::vector<csv_rows> file_rows(files.size());
+  std::vector<char> ok(files.size(), 0);
+  // every file gets a share of the threads by its size, so the files read
+  // at once do not run more workers than one file would
+  std::vector<std::uintmax_t> sizes(files.size(), 0);
+  std::uintmax_t total_size = 0;
+  for (std::size_t i = 0; i < files.size(); ++i) {
+    std::error_code ec;
+    sizes[i] = std::filesystem::file_size(files[i].second, ec);
+    if (ec) {
+      sizes[i] = 0;
+    }
+    total_size += sizes[i];
+  }
+  std::vector<std::thread> threads;
+  threads.reserve(files.size());
+  for (std::size_t i = 0; i < files.size(); ++i) {
+    unsigned int num_threads =
+        total_size == 0 ? 1
+                        : static_cast<unsigned int>(_num_threads * sizes[i] /
+                                                    total_size);
+    num_threads = std::max(1u, num_threads);
+    threads.emplace_back([&, i, num_threads]() {
+      ok[i] = read_file(files[i].first, files[i].second, file_rows[i],
+                        num_threads);
+    });
+  }
+  for (auto &th : threads) {
+    th.join();
+  }
+  if (std::ranges::find(ok, 0) != ok.end()) {
+    return false;
+  }
+  for (auto &rows : file_rows) {
+    merge(rows);
   }
-
-  parse(type, csv, headers);
   return true;
 }
 
-void csv_parser::parse(csv_type type, CsvReaderType &csv_reader,
-                       const std::vector<std::string> &headers) {
-  const int max_idx = headers.size();
-
-  if (type == csv_type::PinAT) {
-    std::vector<PinCol> col_map(max_idx, PinCol::Ignore);
-    auto map_col = [&](const std::string &name, PinCol col_type) {
-      for (int i = 0; i < max_idx; ++i) {
-        if (headers[i] == name) {
-          col_map[i] = col_type;
-          break;
-        }
-      }
-    };
-
-    map_col("pin", PinCol::Pin);
-    map_col("loc_x", PinCol::LocX);
-    map_col("loc_y", PinCol::LocY);
-    map_col("max_rise_slack", PinCol::MaxRiseSlack);
-    map_col("max_fall_slack", PinCol::MaxFallSlack);
-    map_col("max_rise_cap", PinCol::MaxRiseCap);
-    map_col("max_fall_cap", PinCol::MaxFallCap);
-    map_col("max_rise_trans", PinCol::MaxRiseTrans);
-    map_col("max_fall_trans", PinCol::MaxFallTrans);
-    map_col("max_rise_at", PinCol::MaxRiseAt);
-    map_col("max_fall_at", PinCol::MaxFallAt);
-
-    for (const auto &row : csv_reader) {
-      std::string pin_name;
-      double x = 0.0, y = 0.0;
-      double max_rise_slack = 0.0, max_fall_slack = 0.0;
-      double max_rise_cap = 0.0, max_fall_cap = 0.0;
-      double max_rise_trans = 0.0, max_fall_trans = 0.0;
-      double max_rise_at = 0.0, max_fall_at = 0.0;
-
-      bool has_loc_x = false;
-      bool has_loc_y = false;
-      bool row_valid = true;
-
-      int idx = 0;
-      for (const auto &cell : row) {
-        if (idx >= max_idx) {
-          idx++;
-          continue;
-        }
+bool csv_parser::read_file(csv_type type, const std::string &filename,
+                           csv_rows &rows, unsigned int num_threads) const {
+  boost::iostreams::mapped_file_source file;
+  try {
+    file.open(filename);
+  } catch (const std::exception &err) {
+    fmt::print(fmt::fg(fmt::color::red), "Cannot open csv file {}, {}\n",
+               filename, err.what());
+    return false;
+  }
+  read(type, {file.data(), file.size()}, rows, num_threads);
+  return true;
+}
 
-        switch (col_map[idx]) {
-          case PinCol::Pin:
-            pin_name = std::string(cell.read_view());
-            break;
-          case PinCol::LocX:
-            if (fast_parse(cell.read_view(), x)) has_loc_x = true;
-            break;
-          case PinCol::LocY:
-            if (fast_parse(cell.read_view(), y)) has_loc_y = true;
-            break;
-          case PinCol::MaxRiseSlack:
-            if (!fast_parse(cell.read_view(), max_rise_slack))
-              row_valid = false;
-            break;
-          case PinCol::MaxFallSlack:
-            if (!fast_parse(cell.read_view(), max_fall_slack))
-              row_valid = false;
-            break;
-          case PinCol::MaxRiseCap:
-            if (!fast_parse(cell.read_view(), max_rise_cap)) row_valid = false;
-            break;
-          case PinCol::MaxFallCap:
-            if (!fast_parse(cell.read_view(), max_fall_cap)) row_valid = false;
-            break;
-          case PinCol::MaxRiseTrans:
-            if (!fast_parse(cell.read_view(), max_rise_trans))
-              row_valid = false;
-            break;
-          case PinCol::MaxFallTrans:
-            if (!fast_parse(cell.read_view(), max_fall_trans))
-              row_valid = false;
-            break;
-          case PinCol::MaxRiseAt:
-            if (!fast_parse(cell.read_view(), max_rise_at)) row_valid = false;
-            break;
-          case PinCol::MaxFallAt:
-            if (!fast_parse(cell.read_view(), max_fall_at)) row_valid = false;
-            break;
-          default:
-            break;
-        }
-        idx++;
-      }
+void csv_parser::read(csv_type type, std::string_view text,
+                      csv_rows &rows, unsigned int num_threads) const {
+  const std::size_t header_end = row_end(text, 0, false);
+  std::vector<std::string> headers;
+  CsvReaderType header_reader;
+  header_reader.parse_view(text.substr(0, header_end));
+  for (const auto &cell : header_reader.header()) {
+    headers.push_back(std::string(cell.read_view()));
+  }
 
-      if (!has_loc_x || !has_loc_y || !row_valid || pin_name.empty()) {
-        continue;
-      }
+  std::string_view body = text.substr(header_end);
+  if (body.empty()) {
+    return;
+  }
+  std::size_t num_chunks = std::clamp<std::size_t>(
+      body.size() / _min_chunk_bytes, 1, num_threads);
+  auto chunks = split_rows(body, num_chunks, num_threads);
 
-      double path_slack = std::min(max_rise_slack, max_fall_slack);
-      Pin pin_obj{
-          .name = std::move(pin_name),
-          .transs = std::array<double, 2>{max_rise_trans, max_fall_trans},
-          .path_delays = std::array<double, 2>{max_rise_at, max_fall_at},
-          .location = {x, y},
-          .caps = std::array<double, 2>{max_rise_cap, max_fall_cap},
-          .path_slack = path_slack,
-          .path_slacks = std::array<double, 2>{max_rise_slack, max_fall_slack},
-      };
-      std::string original_name = pin_obj.name;
-      _db.pins[original_name] = std::make_shared<Pin>(std::move(pin_obj));
-    }
+  const bool is_pin = type == csv_type::PinAT;
+  std::vector<PinCol> pin_cols;
+  std::vector<ArcCol> arc_cols;
+  if (is_pin) {
+    pin_cols = map_columns<PinCol>(
+        headers, {{"pin", PinCol::Pin},
+                  {"loc_x", PinCol::LocX},
+                  {"loc_y", PinCol::LocY},
+                  {"max_rise_slack", PinCol::MaxRiseSlack},
+                  {"max_fall_slack", PinCol::MaxFallSlack},
+                  {"max_rise_cap", PinCol::MaxRiseCap},
+                  {"max_fall_cap", PinCol::MaxFallCap},
+                  {"max_rise_trans", PinCol::MaxRiseTrans},
+                  {"max_fall_trans", PinCol::MaxFallTrans},
+                  {"max_rise_at", PinCol::MaxRiseAt},
+                  {"max_fall_at", PinCol::MaxFallAt}});
   } else {
-    // Arc Parsing
-    std::vector<ArcCol> col_map(max_idx, ArcCol::Ignore);
-    auto map_col = [&](const std::string &name, ArcCol col_type) {
-      for (int i = 0; i < max_idx; ++i) {
-        if (headers[i] == name) {
-          col_map[i] = col_type;
-          break;
-        }
+    arc_cols = map_columns<ArcCol>(
+        headers, {{"from_pin", ArcCol::FromPin},
+                  {"to_pin", ArcCol::ToPin},
+                  {"setup_delay_rise", ArcCol::SetupDelayRise},
+                  {"setup_delay_fall", ArcCol::SetupDelayFall}});
+    if (type == csv_type::NetArcFanout) {
+      auto it = std::ranges::find(headers, "fanout");
+      if (it != headers.end()) {
+        arc_cols[it - headers.begin()] = ArcCol::Fanout;
       }
-    };
-
-    map_col("from_pin", ArcCol::FromPin);
-    map_col("to_pin", ArcCol::ToPin);
-    map_col("setup_delay_rise", ArcCol::SetupDelayRise);
-    map_col("setup_delay_fall", ArcCol::SetupDelayFall);
-    bool is_net_arc_fanout = (type == csv_type::NetArcFanout);
-    if (is_net_arc_fanout) {
-      map_col("fanout", ArcCol::Fanout);
     }
+  }
 
-    bool is_cell_arc = (type == csv_type::CellArc);
-    arc_type arc_type_val = is_cell_arc ? arc_type::CellArc : arc_type::NetArc;
-
-    for (const auto &row : csv_reader) {
-      std::string from_pin, to_pin;
-      double setup_delay_rise = 0.0;
-      double setup_delay_fall = 0.0;
-      int fanout_val = 0;
-      bool row_valid = true;
-
-      int idx = 0;
-      for (const auto &cell : row) {
-        if (idx >= max_idx) {
-          idx++;
-          continue;
-        }
-
-        switch (col_map[idx]) {
-          case ArcCol::FromPin:
-            from_pin = std::string(cell.read_view());
-            break;
-          case ArcCol::ToPin:
-            to_pin = std::string(cell.read_view());
-            break;
-          case ArcCol::SetupDelayRise:
-            if (!fast_parse(cell.read_view(), setup_delay_rise))
-              row_valid = false;
-            break;
-          case ArcCol::SetupDelayFall:
-            if (!fast_parse(cell.read_view(), setup_delay_fall))
-              row_valid = false;
-            break;
-          case ArcCol::Fanout:
-            if (!fast_parse(cell.read_view(), fanout_val)) row_valid = false;
-            break;
-          default:
-            break;
+  std::vector<csv_rows> chunk_rows(chunks.size());
+  parallel_for(
+      chunks.size(),
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        for (std::size_t c = begin_idx; c < end_idx; ++c) {
+          CsvChunkReaderType csv_reader;
+          csv_reader.parse_view(chunks[c]);
+          auto &local = chunk_rows[c];
+          for (const auto &row : csv_reader) {
+            if (is_pin) {
+              if (auto pin = read_pin(row, pin_cols, _keep_pin)) {
+                local.pins.push_back(std::move(pin));
+              }
+            } else if (auto arc = read_arc(row, arc_cols, type)) {
+              local.arcs.push_back(std::move(arc));
+            }
+          }
         }
-        idx++;
-      }
+      },
+      num_threads);
 
-      if (!row_valid || from_pin.empty() || to_pin.empty()) {
-        continue;
-      }
-
-      if (setup_delay_rise > 1e5 || setup_delay_fall > 1e5) {
-        continue;
-      }
-
-      std::optional<int> fanout;
-      if (is_net_arc_fanout) {
-        fanout = fanout_val;
-      }
+  std::size_t num_arcs = rows.arcs.size();
+  std::size_t num_pins = rows.pins.size();
+  for (const auto &local : chunk_rows) {
+    num_arcs += local.arcs.size();
+    num_pins += local.pins.size();
+  }
+  rows.arcs.reserve(num_arcs);
+  rows.pins.reserve(num_pins);
+  for (auto &local : chunk_rows) {
+    std::ranges::move(local.arcs, std::back_inserter(rows.arcs));
+    std::ranges::move(local.pins, std::back_inserter(rows.pins));
+  }
+}
 
-      Arc arc_obj{.type = arc_type_val,
-                  .from_pin = std::move(from_pin),
-                  .to_pin = std::move(to_pin),
-                  .delay = {setup_delay_rise, setup_delay_fall},
-                  .fanout = fanout};
-      _db.add_arc(is_cell_arc, std::make_shared<Arc>(std::move(arc_obj)));
-    }
+void csv_parser::merge(csv_rows &rows) {
+  _db.arcs.reserve(_db.arcs.size() + rows.arcs.size());
+  for (auto &arc : rows.arcs) {
+    _db.add_arc(arc);
+  }
+  _db.pins.reserve(_db.pins.size() + rows.pins.size());
+  for (auto &pin : rows.pins) {
+    std::string name = pin->name;
+    _db.pins[std::move(name)] = std::move(pin);
   }
+  rows = {};
 }
@@ -1,9 +1,14 @@
 #pragma once
+#include <functional>
 #include <map>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include "csv2/reader.hpp"
 #include "dm/dm.h"
+#include "utils/parallel.h"
 
 // Define the full templated type for csv2::Reader
 using CsvReaderType =
@@ -18,17 +23,44 @@ enum class csv_type {
   PinAT,
 };
 
+// csv_parser splits the body of a mmapped csv at row boundaries, every
+// worker reads its chunk into thread-local arcs / pins, and the chunks are
+// merged into _db in file order, so the result matches a sequential read.
 class csv_parser {
  public:
   csv_parser(){};
   void set_max_paths(std::size_t max_paths) { _max_paths = max_paths; }
+  void set_num_threads(unsigned int num_threads) {
+    _num_threads = std::max(1u, num_threads);
+  }
+  // at csv rows of pins the filter rejects are skipped
+  void set_pin_filter(std::function<bool(std::string_view)> keep_pin) {
+    _keep_pin = std::move(keep_pin);
+  }
   bool parse_file(csv_type type, const std::string &filename);
-  void parse(csv_type type, CsvReaderType &ifs,
-             const std::vector<std::string> &headers);
+  // read all files concurrently, merged into _db in the given order; the
+  // threads are shared out between the files by their size
+  bool parse_files(
+      const std::vector<std::pair<csv_type, std::string>> &files);
 
   const basedb &get_db() const { return _db; }
 
+ private:
+  struct csv_rows {
+    std::vector<std::shared_ptr<Arc>> arcs;
+    std::vector<std::shared_ptr<Pin>> pins;
+  };
+  bool read_file(csv_type type, const std::string &filename, csv_rows &rows,
+                 unsigned int num_threads) const;
+  void read(csv_type type, std::string_view text, csv_rows &rows,
+            unsigned int num_threads) const;
+  void merge(csv_rows &rows);
+
  public:
   basedb _db;
   std::size_t _max_paths = 0;
+  unsigned int _num_threads = default_num_threads();
+  std::function<bool(std::string_view)> _keep_pin;
+  // a chunk is at least this large, small files are read by one worker
+  static constexpr std::size_t _min_chunk_bytes = 1 << 20;
 };
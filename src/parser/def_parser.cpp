@@ -1,122 +1,307 @@
 #include "parser/def_parser.h"
 
-#include <fmt/ranges.h>
+#include <fmt/color.h>
+#include <fmt/core.h>
 
+#include <algorithm>
+#include <boost/iostreams/device/mapped_file.hpp>
 #include <boost/iostreams/filter/gzip.hpp>
 #include <boost/iostreams/filtering_streambuf.hpp>
+#include <cctype>
+#include <charconv>
 #include <fstream>
 #include <thread>
 
-#include "re2/re2.h"
 #include "utils/utils.h"
 
-bool def_parser::parse_file(const std::string &filename) {
-  std::ifstream file(filename, std::ios_base::in | std::ios_base::binary);
-  if (!isgz(filename)) {
-    file.close();
-    std::ifstream simple_file(filename);
+namespace {
+// position of keyword at the start of a line (indentation allowed) and
+// followed by a space, npos if there is none from pos on
+std::size_t find_statement(std::string_view text, std::string_view keyword,
+                           std::size_t pos = 0) {
+  for (pos = text.find(keyword, pos); pos != std::string_view::npos;
+       pos = text.find(keyword, pos + 1)) {
+    std::size_t line = text.rfind('\n', pos);
+    line = line == std::string_view::npos ? 0 : line + 1;
+    bool line_start = text.substr(line, pos - line).find_first_not_of(" \t") ==
+                      std::string_view::npos;
+    std::size_t after = pos + keyword.size();
+    bool word_end = after == text.size() ||
+                    std::isspace(static_cast<unsigned char>(text[after]));
+    if (line_start && word_end) {
+      return pos;
+    }
+  }
+  return std::string_view::npos;
+}
+
+// the number following pos, skipping spaces
+template <typename T>
+bool read_number(std::string_view text, std::size_t pos, T &value) {
+  pos = text.find_first_not_of(" \t\r\n", pos);
+  if (pos == std::string_view::npos) {
+    return false;
+  }
+  auto [ptr, ec] =
+      std::from_chars(text.data() + pos, text.data() + text.size(), value);
+  return ec == std::errc();
+}
+
+// body of a "<keyword> <count> ;" ... "END <keyword>" section, empty if the
+// DEF has no such section
+std::string_view section(std::string_view text, std::string_view keyword,
+                         std::size_t &count) {
+  constexpr auto npos = std::string_view::npos;
+  std::size_t begin = find_statement(text, keyword);
+  if (begin == npos) {
+    return {};
+  }
+  read_number(text, begin + keyword.size(), count);
+  std::size_t body_begin = text.find(';', begin);
+  if (body_begin == npos) {
+    return {};
+  }
+  ++body_begin;
+  std::size_t body_end =
+      find_statement(text, fmt::format("END {}", keyword), body_begin);
+  if (body_end == npos) {
+    body_end = text.size();
+  }
+  return text.substr(body_begin, body_end - body_begin);
+}
 
-    if (!simple_file.is_open()) {
-      return false;
+// the next whitespace separated token of sv, sv is advanced past it
+std::string_view next_token(std::string_view &sv) {
+  std::size_t begin = sv.find_first_not_of(" \t\r\n");
+  if (begin == std::string_view::npos) {
+    sv = {};
+    return {};
+  }
+  std::size_t end = std::min(sv.find_first_of(" \t\r\n", begin), sv.size());
+  std::string_view token = sv.substr(begin, end - begin);
+  sv.remove_prefix(end);
+  return token;
+}
+
+std::string_view trim(std::string_view sv) {
+  std::size_t begin = sv.find_first_not_of(" \t\r\n");
+  if (begin == std::string_view::npos) {
+    return {};
+  }
+  std::size_t end = sv.find_last_not_of(" \t\r\n");
+  return sv.substr(begin, end - begin + 1);
+}
+
+// func(statement) for every "- ..." statement of body, without its ';'
+template <typename Func>
+void for_each_statement(std::string_view body, Func &&func) {
+  while (!body.empty()) {
+    std::size_t semi = std::min(body.find(';'), body.size());
+    std::string_view statement = trim(body.substr(0, semi));
+    body.remove_prefix(std::min(semi + 1, body.size()));
+    if (!statement.empty() && statement.front() == '-') {
+      func(statement);
     }
-    parse(simple_file);
-    simple_file.close();
-  } else {
+  }
+}
+}  // namespace
+
+bool def_parser::parse_file(const std::string &filename) {
+  if (isgz(filename)) {
+    std::ifstream file(filename, std::ios_base::in | std::ios_base::binary);
     boost::iostreams::filtering_streambuf<boost::iostreams::input> inbuf;
     inbuf.push(boost::iostreams::gzip_decompressor());
     inbuf.push(file);
-    // Convert streambuf to istream
-    std::istream instream(&inbuf);
-    parse(instream);
-    file.close();
+    std::string text(std::istreambuf_iterator<char>(&inbuf), {});
+    return parse(text);
   }
-  return true;
+  boost::iostreams::mapped_file_source file;
+  try {
+    file.open(filename);
+  } catch (const std::exception &err) {
+    fmt::print(fmt::fg(fmt::color::red), "Cannot open def file {}, {}\n",
+               filename, err.what());
+    return false;
+  }
+  return parse({file.data(), file.size()});
 }
 
-// 数据准备线程函数
-void def_parser::data_preparation(std::istream &instream) {
-  std::string line;
-  std::vector<std::string> path;
-  bool start_flag = false;
-  bool component_flag = false;
-  while (std::getline(instream, line)) {
-    if (RE2::PartialMatch(line, _begin_pattern)) {
-      component_flag = true;
-    }
-    if (RE2::PartialMatch(line, _end_pattern)) {
-      break;
+bool def_parser::parse(std::string_view text) {
+  // UNITS DISTANCE MICRONS <dbu> ;
+  if (std::size_t units = find_statement(text, "UNITS");
+      units != std::string_view::npos) {
+    std::string_view line = text.substr(units, text.find(';', units) - units);
+    std::size_t microns = line.find("MICRONS");
+    double dbu = 0.;
+    if (microns != std::string_view::npos &&
+        read_number(line, microns + std::string_view("MICRONS").size(), dbu) &&
+        dbu > 0.) {
+      _dbu = dbu;
     }
-    if (!component_flag) {
-      continue;
+  }
+
+  std::size_t num_components = 0;
+  parse_components(section(text, "COMPONENTS", num_components),
+                   num_components);
+  std::size_t num_io_pins = 0;
+  parse_io_pins(section(text, "PINS", num_io_pins), num_io_pins);
+  std::size_t num_nets = 0;
+  parse_nets(section(text, "NETS", num_nets), num_nets);
+  return true;
+}
+
+std::vector<std::string_view> def_parser::split_statements(
+    std::string_view body) const {
+  // chunks start right after a ';', i.e. at a statement boundary
+  const std::size_t num_chunks = std::clamp<std::size_t>(
+      body.size() / _min_chunk_bytes, 1, _num_threads);
+  const std::size_t step = (body.size() + num_chunks - 1) / num_chunks;
+  std::vector<std::string_view> chunks;
+  chunks.reserve(num_chunks);
+  std::size_t begin = 0;
+  for (std::size_t c = 1; c <= num_chunks && begin < body.size(); ++c) {
+    std::size_t end = body.size();
+    if (c < num_chunks) {
+      std::size_t semi = body.find(';', std::max(begin, c * step));
+      end = semi == std::string_view::npos ? body.size() : semi + 1;
     }
-    if (RE2::PartialMatch(line, _start_pattern)) {
-      if (start_flag) {
-        std::lock_guard<std::mutex> lock(_data_mutex);
-        _data_queue.push(path);
-        path.clear();
-        _data_cond_var.notify_one();  // 通知等待的数据处理线程
+    chunks.push_back(body.substr(begin, end - begin));
+    begin = end;
+  }
+  return chunks;
+}
+
+void def_parser::parse_components(std::string_view body,
+                                  std::size_t num_components) {
+  auto chunks = split_statements(body);
+  std::vector<std::vector<cell_property>> chunk_cells(chunks.size());
+  parallel_for(
+      chunks.size(),
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        for (std::size_t c = begin_idx; c < end_idx; ++c) {
+          auto &cells = chunk_cells[c];
+          cells.reserve(num_components / chunks.size() + 1);
+          for_each_statement(chunks[c], [&](std::string_view statement) {
+            cells.push_back(parse_cell(statement));
+          });
+        }
+      },
+      _num_threads);
+
+  // first definition wins, as in the file order
+  _type_map.reserve(_type_map.size() + num_components);
+  _loc_map.reserve(_loc_map.size() + num_components);
+  std::thread type_thread([&]() {
+    for (auto &cells : chunk_cells) {
+      for (auto &cell : cells) {
+        _type_map.emplace(cell.name, std::move(cell.cell));
       }
-      start_flag = true;
     }
-    if (start_flag) {
-      path.emplace_back(line);
+  });
+  for (const auto &cells : chunk_cells) {
+    for (const auto &cell : cells) {
+      if (cell.placed) {
+        _loc_map.emplace(cell.name, std::make_pair(cell.x, cell.y));
+      }
     }
   }
-  std::lock_guard<std::mutex> lock(_data_mutex);
-  _data_queue.push(path);
-  path.clear();
-  _done = true;
-  _data_cond_var.notify_all();  // 通知可能在等待的处理线程
+  type_thread.join();
 }
 
-void def_parser::data_processing() {
-  std::vector<std::string> path;
-  while (true) {
-    std::unique_lock<std::mutex> lock(_data_mutex);
-    _data_cond_var.wait(lock, [this] { return !_data_queue.empty() || _done; });
-    if (_data_queue.empty() && _done) {
+void def_parser::parse_io_pins(std::string_view body,
+                               std::size_t num_io_pins) {
+  // - name + NET net ... + PLACED ( x y ) N
+  _io_loc_map.reserve(num_io_pins);
+  for_each_statement(body, [&](std::string_view statement) {
+    statement.remove_prefix(1);
+    std::string_view name = next_token(statement);
+    for (std::string_view token = next_token(statement); !token.empty();
+         token = next_token(statement)) {
+      if (token != "PLACED" && token != "FIXED" && token != "COVER") {
+        continue;
+      }
+      double x = 0., y = 0.;
+      if (next_token(statement) == "(" &&
+          read_number(next_token(statement), 0, x) &&
+          read_number(next_token(statement), 0, y)) {
+        _io_loc_map.emplace(name, std::make_pair(x / _dbu, y / _dbu));
+      }
       break;
     }
-    path = _data_queue.front();
-    _data_queue.pop();
-    lock.unlock();
-    auto cell_obj = parse_cell(path);
-    lock.lock();
-    _type_map.emplace(cell_obj.name, cell_obj.cell);
-    _loc_map.emplace(cell_obj.name, std::make_pair(cell_obj.x, cell_obj.y));
-    lock.unlock();
-  }
+  });
 }
 
-void def_parser::parse(std::istream &instream) {
-  std::thread producer([this, &instream] { data_preparation(instream); });
-  std::vector<std::thread> consumers;
-  for (int i = 0; i < _num_consumers; i++) {
-    consumers.emplace_back([this] { data_processing(); });
-  }
-  producer.join();
-  for (auto &consumer : consumers) {
-    consumer.join();
+void def_parser::parse_nets(std::string_view body, std::size_t num_nets) {
+  // - name ( inst pin ) ( PIN io ) ... + ROUTED ...
+  auto chunks = split_statements(body);
+  std::vector<net_store> chunk_nets(chunks.size());
+  parallel_for(
+      chunks.size(),
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        for (std::size_t c = begin_idx; c < end_idx; ++c) {
+          auto &nets = chunk_nets[c];
+          nets.reserve(num_nets / chunks.size() + 1, 0);
+          for_each_statement(chunks[c], [&](std::string_view statement) {
+            statement.remove_prefix(1);
+            nets.add_net(std::string(next_token(statement)));
+            for (std::string_view token = next_token(statement);
+                 !token.empty() && token != "+";
+                 token = next_token(statement)) {
+              if (token != "(") {
+                continue;  // e.g. MUSTJOIN
+              }
+              std::string_view inst = next_token(statement);
+              std::string_view pin = next_token(statement);
+              next_token(statement);  // )
+              if (inst == "PIN") {
+                nets.add_pin(std::string(pin));
+              } else if (inst != "*") {
+                nets.add_pin(fmt::format("{}/{}", inst, pin));
+              }
+            }
+          });
+        }
+      },
+      _num_threads);
+
+  for (auto &nets : chunk_nets) {
+    _nets.append(std::move(nets));
   }
+  _nets.build_index();
+  // a pin sits at the origin of its component, as in update_loc_from_map
+  _nets.compute_boxes(
+      [&](std::string_view pin) -> const std::pair<double, double> * {
+        thread_local std::string name_buf;
+        std::size_t slash = pin.rfind('/');
+        const auto &locs =
+            slash == std::string_view::npos ? _io_loc_map : _loc_map;
+        name_buf.assign(pin.substr(0, std::min(slash, pin.size())));
+        auto it = locs.find(name_buf);
+        return it == locs.end() ? nullptr : &it->second;
+      },
+      _num_threads);
 }
 
-cell_property def_parser::parse_cell(const std::vector<std::string> &path) {
-  // cell_property cell_obj;
-  std::string line = fmt::format("{}", fmt::join(path, " "));
-  client::property::cell_obj cell_obj;
-  auto &component_grammar = client::grammar::cell_obj;
-  auto iter = line.begin();
-  auto end = line.end();
+cell_property def_parser::parse_cell(std::string_view statement) const {
   boost::spirit::x3::ascii::space_type space;
-  bool r = boost::spirit::x3::phrase_parse(iter, end, component_grammar, space,
-                                           cell_obj);
-  if (!r || iter != end) {
+  client::property::cell_obj cell_obj;
+  auto iter = statement.begin();
+  auto end = statement.end();
+  if (boost::spirit::x3::phrase_parse(iter, end, client::grammar::cell_obj,
+                                      space, cell_obj) &&
+      iter == end) {
+    return {std::move(cell_obj.name), std::move(cell_obj.cell),
+            cell_obj.x / _dbu, cell_obj.y / _dbu};
+  }
+  client::property::cell_head cell_head;
+  iter = statement.begin();
+  if (!boost::spirit::x3::phrase_parse(iter, end, client::grammar::cell_head,
+                                       space, cell_head) ||
+      iter != end) {
     std::string rest(iter, end);
     fmt::print("Parsing def component failed, stopped at \"{}\"\n", rest);
     std::exit(1);
   }
-  cell_property cell{cell_obj.name, cell_obj.cell, cell_obj.x / 2000.,
-                     cell_obj.y / 2000.};
-
-  return cell;
+  return {std::move(cell_head.name), std::move(cell_head.cell), 0., 0.,
+          false};
 }
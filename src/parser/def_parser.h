@@ -1,22 +1,23 @@
 #pragma once
 #include <absl/container/flat_hash_map.h>
-#include <re2/re2.h>
 
 #include <boost/fusion/include/adapt_struct.hpp>
 #include <boost/spirit/home/x3.hpp>
 #include <boost/spirit/home/x3/support/ast/variant.hpp>
-#include <condition_variable>
 #include <iostream>
-#include <mutex>
-#include <queue>
 #include <string>
+#include <string_view>
 #include <vector>
 
+#include "dm/net_store.h"
+#include "utils/parallel.h"
+
 struct cell_property {
   std::string name;
   std::string cell;
   double x;
   double y;
+  bool placed = true;  // false for UNPLACED components, x / y are unset
 };
 
 namespace client {
@@ -28,10 +29,16 @@ struct cell_obj {
   int x;
   int y;
 };
+
+struct cell_head {
+  std::string name;
+  std::string cell;
+};
 }  // namespace property
 }  // namespace client
 
 BOOST_FUSION_ADAPT_STRUCT(client::property::cell_obj, name, cell, x, y)
+BOOST_FUSION_ADAPT_STRUCT(client::property::cell_head, name, cell)
 
 namespace client {
 namespace grammar {
@@ -42,45 +49,69 @@ using x3::space;
 
 x3::rule<class word, std::string> const word("word");
 x3::rule<class coordinates, property::cell_obj> const cell_obj("cell_obj");
+x3::rule<class head, property::cell_head> const cell_head("cell_head");
 
 // Define the word parser (matches characters until space)
 auto const word_def = x3::lexeme[+(char_ - space)];
 auto const omit_inner = x3::omit[x3::lexeme[+(x3::char_ - x3::char_("()"))]];
-auto const appendix = x3::omit[x3::lexeme[+(x3::char_)]];
+auto const appendix = x3::omit[x3::lexeme[*(x3::char_)]];
 
 auto const cell_obj_def =
     "-" >> word >> word >> omit_inner >> '(' >> int_ >> int_ >> ')' >> appendix;
+// a component without a location, e.g. + UNPLACED
+auto const cell_head_def = "-" >> word >> word >> appendix;
 
-BOOST_SPIRIT_DEFINE(word, cell_obj)
+BOOST_SPIRIT_DEFINE(word, cell_obj, cell_head)
 }  // namespace grammar
 }  // namespace client
 
+// def_parser reads the COMPONENTS, PINS and NETS sections of a DEF. The
+// file is mmapped (or inflated once if gzipped), a section is cut into
+// chunks at statement boundaries and parsed on several threads; locations
+// are converted to microns with the UNITS DISTANCE MICRONS of the file.
 class def_parser {
  public:
-  const absl::flat_hash_map<std::string, std::string> get_type_map() const {
+  const absl::flat_hash_map<std::string, std::string> &get_type_map() const {
     return _type_map;
   }
-  const absl::flat_hash_map<std::string, std::pair<double, double>>
+  const absl::flat_hash_map<std::string, std::pair<double, double>> &
   get_loc_map() const {
     return _loc_map;
   }
+  // hand the maps over, the parser is left empty
+  absl::flat_hash_map<std::string, std::string> take_type_map() {
+    return std::move(_type_map);
+  }
+  absl::flat_hash_map<std::string, std::pair<double, double>> take_loc_map() {
+    return std::move(_loc_map);
+  }
+  // nets of the NETS section with the box of their placed pins
+  const net_store &get_nets() const { return _nets; }
+  net_store take_nets() { return std::move(_nets); }
+  void set_num_threads(unsigned int num_threads) {
+    _num_threads = std::max(1u, num_threads);
+  }
+  double get_dbu() const { return _dbu; }
+
   bool parse_file(const std::string &filename);
-  void parse(std::istream &instream);
-  void data_preparation(std::istream &instream);
-  void data_processing();
+  bool parse(std::string_view text);
   void print_paths();
-  cell_property parse_cell(const std::vector<std::string> &path);
+  // statement of one component, without the closing ';'
+  cell_property parse_cell(std::string_view statement) const;
+
+ private:
+  std::vector<std::string_view> split_statements(std::string_view body) const;
+  void parse_components(std::string_view body, std::size_t num_components);
+  void parse_io_pins(std::string_view body, std::size_t num_io_pins);
+  void parse_nets(std::string_view body, std::size_t num_nets);
 
  private:
   absl::flat_hash_map<std::string, std::string> _type_map;
   absl::flat_hash_map<std::string, std::pair<double, double>> _loc_map;
-  std::queue<std::vector<std::string>> _data_queue;
-  std::mutex _data_mutex;
-  std::condition_variable _data_cond_var;
-  bool _done = false;  // 标志是否完成数据准备
-  int _num_consumers = 4;
-
-  const RE2 _begin_pattern{"^COMPONENTS"};
-  const RE2 _end_pattern{"^END COMPONENTS"};
-  const RE2 _start_pattern{"^\\s*-"};
+  absl::flat_hash_map<std::string, std::pair<double, double>> _io_loc_map;
+  net_store _nets;
+  // database units per micron, used when the DEF has no UNITS statement
+  double _dbu = 2000.;
+  unsigned int _num_threads = default_num_threads();
+  static constexpr std::size_t _min_chunk_bytes = 1 << 20;
 };
@@ -0,0 +1,335 @@
+#include "json_parser.h"
+
+#include <fmt/color.h>
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <atomic>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_streambuf.hpp>
+#include <fstream>
+#include <iterator>
+
+#include "utils/design_cons.h"
+#include "utils/utils.h"
+#include "yyjson.h"
+
+namespace {
+constexpr std::string_view whitespace = " \t\r\n";
+
+// one past the closing quote of the string starting at pos
+std::size_t skip_string(std::string_view text, std::size_t pos) {
+  for (++pos; pos < text.size(); ++pos) {
+    pos = text.find_first_of("\"\\", pos);
+    if (pos == std::string_view::npos) {
+      break;
+    }
+    if (text[pos] == '"') {
+      return pos + 1;
+    }
+    ++pos;  // escaped character
+  }
+  return std::string_view::npos;
+}
+
+// one past the json value starting at pos, only brackets and strings are
+// tracked, yyjson validates the rest later
+std::size_t skip_value(std::string_view text, std::size_t pos) {
+  if (text[pos] == '"') {
+    return skip_string(text, pos);
+  }
+  if (text[pos] != '{' && text[pos] != '[') {
+    return std::min(text.find_first_of(",]}", pos), text.size());
+  }
+  int depth = 0;
+  while (pos < text.size()) {
+    pos = text.find_first_of("\"{}[]", pos);
+    if (pos == std::string_view::npos) {
+      break;
+    }
+    char c = text[pos];
+    if (c == '"') {
+      pos = skip_string(text, pos);
+      continue;
+    }
+    depth += (c == '{' || c == '[') ? 1 : -1;
+    ++pos;
+    if (depth == 0) {
+      return pos;
+    }
+  }
+  return std::string_view::npos;
+}
+
+std::size_t skip_whitespace(std::string_view text, std::size_t pos) {
+  return std::min(text.find_first_not_of(whitespace, pos), text.size());
+}
+
+struct top_level {
+  std::string_view design;  // raw json values
+  std::string_view type;
+  std::vector<std::string_view> paths;
+};
+
+// walk the root object and cut the paths array into its elements
+bool split_top_level(std::string_view text, top_level &root) {
+  std::size_t pos = skip_whitespace(text, 0);
+  if (pos == text.size() || text[pos] != '{') {
+    return false;
+  }
+  pos = skip_whitespace(text, pos + 1);
+  while (pos < text.size() && text[pos] != '}') {
+    std::size_t key_end = skip_string(text, pos);
+    if (text[pos] != '"' || key_end == std::string_view::npos) {
+      return false;
+    }
+    std::string_view key = text.substr(pos + 1, key_end - pos - 2);
+    pos = skip_whitespace(text, key_end);
+    if (pos == text.size() || text[pos] != ':') {
+      return false;
+    }
+    pos = skip_whitespace(text, pos + 1);
+    if (pos == text.size()) {
+      return false;
+    }
+    if (key == "paths" && text[pos] == '[') {
+      pos = skip_whitespace(text, pos + 1);
+      while (pos < text.size() && text[pos] != ']') {
+        std::size_t value_end = skip_value(text, pos);
+        if (value_end == std::string_view::npos) {
+          return false;
+        }
+        root.paths.push_back(text.substr(pos, value_end - pos));
+        pos = skip_whitespace(text, value_end);
+        if (pos < text.size() && text[pos] == ',') {
+          pos = skip_whitespace(text, pos + 1);
+        }
+      }
+      ++pos;
+    } else {
+      std::size_t value_end = skip_value(text, pos);
+      if (value_end == std::string_view::npos) {
+        return false;
+      }
+      if (key == "design") {
+        root.design = text.substr(pos, value_end - pos);
+      } else if (key == "type") {
+        root.type = text.substr(pos, value_end - pos);
+      }
+      pos = value_end;
+    }
+    pos = skip_whitespace(text, pos);
+    if (pos < text.size() && text[pos] == ',') {
+      pos = skip_whitespace(text, pos + 1);
+    }
+  }
+  return pos < text.size();
+}
+
+std::string get_string(yyjson_val *obj, const char *key) {
+  yyjson_val *val = yyjson_obj_get(obj, key);
+  if (!yyjson_is_str(val)) {
+    return {};
+  }
+  return {yyjson_get_str(val), yyjson_get_len(val)};
+}
+
+std::optional<double> get_number(yyjson_val *obj, const char *key) {
+  yyjson_val *val = yyjson_obj_get(obj, key);
+  if (!yyjson_is_num(val)) {
+    return std::nullopt;
+  }
+  return yyjson_get_num(val);
+}
+
+// a raw json string value cut out by split_top_level
+std::string unquote(std::string_view raw) {
+  if (raw.empty()) {
+    return {};
+  }
+  std::string value;
+  yyjson_doc *doc = yyjson_read(raw.data(), raw.size(), YYJSON_READ_NOFLAG);
+  if (doc != nullptr) {
+    yyjson_val *root = yyjson_doc_get_root(doc);
+    if (yyjson_is_str(root)) {
+      value.assign(yyjson_get_str(root), yyjson_get_len(root));
+    }
+    yyjson_doc_free(doc);
+  }
+  return value;
+}
+
+std::shared_ptr<Path> build_path(yyjson_val *path_obj,
+                                 const std::string &pin_type) {
+  auto path = std::make_shared<Path>();
+  path->startpoint = get_string(path_obj, "startpoint");
+  path->endpoint = get_string(path_obj, "endpoint");
+  path->group = get_string(path_obj, "path_group");
+  path->clock = get_string(path_obj, "clock");
+  path->slack = get_number(path_obj, "slack").value_or(0.);
+
+  yyjson_val *params = yyjson_obj_get(path_obj, "path_params");
+  if (yyjson_is_obj(params)) {
+    std::size_t idx, max;
+    yyjson_val *key, *val;
+    yyjson_obj_foreach(params, idx, max, key, val) {
+      path->path_params.emplace(
+          std::string(yyjson_get_str(key), yyjson_get_len(key)),
+          yyjson_get_num(val));
+    }
+  }
+
+  yyjson_val *pins = yyjson_obj_get(path_obj, "path");
+  if (!yyjson_is_arr(pins)) {
+    return path;
+  }
+  path->path.reserve(yyjson_arr_size(pins));
+  std::shared_ptr<Pin> prev_pin;
+  std::size_t idx, max;
+  yyjson_val *pin_obj;
+  yyjson_arr_foreach(pins, idx, max, pin_obj) {
+    auto pin = std::make_shared<Pin>();
+    pin->name = get_string(pin_obj, "name");
+    pin->type = pin_type;
+    pin->incr_delay = get_number(pin_obj, "incr_delay");
+    pin->path_delay = get_number(pin_obj, "path_delay");
+    pin->trans = get_number(pin_obj, "trans");
+    pin->pta_buf = get_number(pin_obj, "pta_buf");
+    pin->pta_net = get_number(pin_obj, "pta_net");
+    pin->is_input = yyjson_get_bool(yyjson_obj_get(pin_obj, "is_input"));
+    pin->rise_fall = yyjson_get_bool(yyjson_obj_get(pin_obj, "rf"));
+    yyjson_val *loc = yyjson_obj_get(pin_obj, "location");
+    if (yyjson_is_arr(loc) && yyjson_arr_size(loc) == 2) {
+      pin->location = {yyjson_get_num(yyjson_arr_get(loc, 0)),
+                       yyjson_get_num(yyjson_arr_get(loc, 1))};
+    }
+    if (yyjson_is_str(yyjson_obj_get(pin_obj, "cell"))) {
+      pin->cell = get_string(pin_obj, "cell");
+    }
+    // only the load pin carries its net, the driver is the pin before it
+    yyjson_val *net_obj = yyjson_obj_get(pin_obj, "net");
+    if (yyjson_is_obj(net_obj)) {
+      auto net = std::make_shared<Net>();
+      net->name = get_string(net_obj, "name");
+      net->fanout =
+          static_cast<int>(get_number(net_obj, "fanout").value_or(0));
+      net->cap = get_number(net_obj, "cap").value_or(0.);
+      net->pins = std::make_pair(prev_pin, pin);
+      pin->net = net;
+      if (prev_pin && !prev_pin->net.has_value()) {
+        prev_pin->net = net;
+      }
+    }
+    path->path.push_back(pin);
+    prev_pin = pin;
+  }
+  return path;
+}
+}  // namespace
+
+bool json_parser::parse_file(const std::string &filename) {
+  auto &cons = design_cons::get_instance();
+  _db.design = cons.get_name(filename);
+  if (isgz(filename)) {
+    std::ifstream file(filename, std::ios_base::in | std::ios_base::binary);
+    boost::iostreams::filtering_streambuf<boost::iostreams::input> inbuf;
+    inbuf.push(boost::iostreams::gzip_decompressor());
+    inbuf.push(file);
+    std::string text(std::istreambuf_iterator<char>(&inbuf), {});
+    return parse(text);
+  }
+  boost::iostreams::mapped_file_source file;
+  try {
+    file.open(filename);
+  } catch (const std::exception &err) {
+    fmt::print(fmt::fg(fmt::color::red), "Cannot open json file {}, {}\n",
+               filename, err.what());
+    return false;
+  }
+  return parse({file.data(), file.size()});
+}
+
+bool json_parser::parse(std::string_view text) {
+  top_level root;
+  if (!split_top_level(text, root)) {
+    fmt::print(fmt::fg(fmt::color::red), "Malformed json db\n");
+    return false;
+  }
+  if (auto design = unquote(root.design); !design.empty()) {
+    _db.design = design;
+  }
+  // files of older rpt_serial runs have an empty type, they are leda
+  _db.type = !_tool.empty() ? _tool : unquote(root.type);
+  if (_db.type.empty()) {
+    _db.type = "leda";
+  }
+  return parse_paths(text, root.paths);
+}
+
+bool json_parser::parse_paths(std::string_view text,
+                              const std::vector<std::string_view> &elements) {
+  // consecutive elements of about _chunk_bytes form one yyjson document
+  std::vector<std::size_t> chunk_begins = {0};
+  std::size_t chunk_size = 0;
+  for (std::size_t i = 0; i < elements.size(); ++i) {
+    if (chunk_size >= _chunk_bytes) {
+      chunk_begins.push_back(i);
+      chunk_size = 0;
+    }
+    chunk_size += elements[i].size();
+  }
+  chunk_begins.push_back(elements.size());
+
+  std::vector<std::shared_ptr<Path>> paths(elements.size());
+  std::atomic<bool> failed = false;
+  const std::string pin_type = _db.type;
+  parallel_for(
+      chunk_begins.size() - 1,
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        std::string buffer;  // reused by every chunk of this thread
+        for (std::size_t c = begin_idx; c < end_idx && !failed; ++c) {
+          std::size_t first = chunk_begins[c];
+          std::size_t last = chunk_begins[c + 1];
+          if (first == last) {
+            continue;
+          }
+          // the original separators between elements are kept
+          const char *begin = elements[first].data();
+          const char *end =
+              elements[last - 1].data() + elements[last - 1].size();
+          buffer.assign("[");
+          buffer.append(begin, end);
+          buffer.append("]");
+          std::size_t len = buffer.size();
+          buffer.append(YYJSON_PADDING_SIZE, '\0');
+
+          yyjson_read_err err;
+          yyjson_doc *doc = yyjson_read_opts(buffer.data(), len,
+                                             YYJSON_READ_INSITU, nullptr, &err);
+          if (doc == nullptr) {
+            // the buffer starts with the synthetic '[', the text one later
+            std::size_t pos = std::clamp<std::size_t>(
+                err.pos, 1, static_cast<std::size_t>(end - begin));
+            fmt::print(fmt::fg(fmt::color::red),
+                       "Cannot parse json paths near byte {}: {}\n",
+                       begin - text.data() + pos - 1, err.msg);
+            failed = true;
+            return;
+          }
+          std::size_t idx, max;
+          yyjson_val *path_obj;
+          yyjson_arr_foreach(yyjson_doc_get_root(doc), idx, max, path_obj) {
+            paths[first + idx] = build_path(path_obj, pin_type);
+          }
+          yyjson_doc_free(doc);
+        }
+      },
+      _num_threads);
+  if (failed) {
+    return false;
+  }
+  _db.paths.insert(_db.paths.end(), std::make_move_iterator(paths.begin()),
+                   std::make_move_iterator(paths.end()));
+  return true;
+}
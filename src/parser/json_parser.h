@@ -0,0 +1,36 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "dm/dm.h"
+#include "utils/parallel.h"
+
+// Loads the json written by basedb::serialize_to_yyjson back into a basedb.
+// The top-level paths array is split at element boundaries and the pieces
+// are parsed in-situ by yyjson on worker threads.
+class json_parser {
+ public:
+  json_parser(unsigned int num_threads = default_num_threads())
+      : _num_threads(num_threads) {}
+  bool parse_file(const std::string &filename);
+  bool parse(std::string_view text);
+  // tool the paths come from, overriding the type stored in the file
+  void set_tool(std::string tool) { _tool = std::move(tool); }
+
+  const basedb &get_db() const { return _db; }
+
+ private:
+  bool parse_paths(std::string_view text,
+                   const std::vector<std::string_view> &elements);
+
+ public:
+  basedb _db;
+
+ private:
+  unsigned int _num_threads;
+  std::string _tool;
+  // bytes of path elements handed to yyjson at once
+  static constexpr std::size_t _chunk_bytes = 4 << 20;
+};
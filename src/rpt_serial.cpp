@@ -3,12 +3,27 @@
 #include <argparse/argparse.hpp>
 #include <iostream>
 
+#include "dm/snapshot.h"
+#include "parser/csv_parser.h"
 #include "parser/leda_rpt.h"
 
 int main(int argc, char** argv) {
   argparse::ArgumentParser program("rpt_serial");
-  program.add_argument("rpt_path").help("leda rpt file path");
-  program.add_argument("output_path").help("leda rpt json file output path");
+  program.add_argument("rpt_path")
+      .help("leda rpt file path, or the cell csv with --net_csv");
+  program.add_argument("output_path")
+      .help("output path, <rpt_path>.snap is picked up by slack_tool")
+      .default_value(std::string());
+  program.add_argument("--snapshot")
+      .help("write a binary snapshot instead of json")
+      .default_value(false)
+      .implicit_value(true);
+  program.add_argument("--compact")
+      .help("write json without indentation")
+      .default_value(false)
+      .implicit_value(true);
+  program.add_argument("--net_csv").help("net csv file path");
+  program.add_argument("--at_csv").help("pin at csv file path");
 
   try {
     program.parse_args(argc, argv);
@@ -17,8 +32,49 @@ int main(int argc, char** argv) {
     std::cerr << program;
     std::exit(1);
   }
-  auto parser = std::make_shared<leda_rpt_parser<std::string>>();
-  parser->parse_file(program.get<std::string>("rpt_path"));
-  parser->get_db().serialize_to_yyjson(program.get<std::string>("output_path"));
+  auto rpt_path = program.get<std::string>("rpt_path");
+  auto output_path = program.get<std::string>("output_path");
+  bool to_snapshot = program.get<bool>("--snapshot");
+  if (output_path.empty()) {
+    if (!to_snapshot) {
+      std::cerr << "output_path is required for json output" << std::endl;
+      std::exit(1);
+    }
+    output_path = snapshot::default_path(rpt_path);
+  }
+
+  basedb db;
+  std::vector<snapshot::source> sources;
+  if (auto net_csv = program.present("--net_csv")) {
+    csv_parser parser;
+    auto at_csv = program.present("--at_csv");
+    std::vector<std::pair<csv_type, std::string>> files = {
+        {csv_type::CellArc, rpt_path},
+        {at_csv ? csv_type::NetArcFanout : csv_type::NetArc, *net_csv}};
+    sources = {{"cell_csv", rpt_path}, {"net_csv", *net_csv}};
+    if (at_csv) {
+      files.emplace_back(csv_type::PinAT, *at_csv);
+      sources.push_back({"at_csv", *at_csv});
+    }
+    bool ok = parser.parse_files(files);
+    if (!ok) {
+      std::cerr << "Cannot parse csv files" << std::endl;
+      std::exit(1);
+    }
+    db = parser.get_db();
+    db.arcs.build_index();
+    db.type = "csv";
+  } else {
+    auto parser = std::make_shared<leda_rpt_parser<std::string>>();
+    parser->parse_file(rpt_path);
+    db = parser->get_db();
+    db.type = "leda";
+    sources = {{"path", rpt_path}};
+  }
+  if (!to_snapshot) {
+    db.serialize_to_yyjson(output_path, !program.get<bool>("--compact"));
+  } else if (!snapshot::write(db, output_path, sources)) {
+    std::exit(1);
+  }
   return 0;
 }
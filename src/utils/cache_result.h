@@ -1,14 +1,18 @@
 #pragma once
 
-#include <string_view>
+#include <utility>
 #include <vector>
 
 // cache_result stores the result of a shortest path query
 class cache_result {
  public:
   double distance;
-  std::vector<std::string_view> path;
-  cache_result(double dist, const std::vector<std::string_view> &p)
-      : distance(dist), path(p) {}
-  cache_result() : distance(-1), path({}) {}
+  // graph node ids of the path from the source, see node_name of the graph
+  std::vector<int> nodes;
+  // arc ids of its hops, arcs[i] leads from nodes[i] to nodes[i + 1]; the
+  // position in the arcs the graph was built from, so the arc_store id
+  std::vector<int> arcs;
+  cache_result(double dist, std::vector<int> n, std::vector<int> a)
+      : distance(dist), nodes(std::move(n)), arcs(std::move(a)) {}
+  cache_result() : distance(-1) {}
 };
@@ -0,0 +1,171 @@
+#include "utils/heatmap.h"
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "utils/csv_writer.h"
+
+heatmap::heatmap(const spatial_grid::window &die, int nx, int ny,
+                 std::vector<std::string> metrics, unsigned int num_slots)
+    : _die(die),
+      _nx(std::max(1, nx)),
+      _ny(std::max(1, ny)),
+      _bin_w(std::max(die[2] - die[0], 1e-9) / _nx),
+      _bin_h(std::max(die[3] - die[1], 1e-9) / _ny),
+      _metrics(std::move(metrics)),
+      _slots(std::max(1u, num_slots)) {}
+
+void heatmap::add(unsigned int slot, const std::pair<double, double> &loc,
+                  std::span<const double> values) {
+  const auto &[x, y] = loc;
+  if (x < _die[0] || x > _die[2] || y < _die[1] || y > _die[3]) {
+    return;
+  }
+  // the upper border belongs to the last bin
+  int bx = std::min(static_cast<int>((x - _die[0]) / _bin_w), _nx - 1);
+  int by = std::min(static_cast<int>((y - _die[1]) / _bin_h), _ny - 1);
+  auto &s = _slots[slot];
+  s.bins.push_back(static_cast<std::uint32_t>(by) * _nx + bx);
+  for (std::size_t m = 0; m < _metrics.size(); ++m) {
+    s.values.push_back(m < values.size()
+                           ? values[m]
+                           : std::numeric_limits<double>::quiet_NaN());
+  }
+}
+
+std::size_t heatmap::size() const {
+  std::size_t n = 0;
+  for (const auto &s : _slots) {
+    n += s.bins.size();
+  }
+  return n;
+}
+
+void heatmap::write(const std::string &filename, const std::string &output_dir,
+                    const std::vector<double> &percentiles,
+                    unsigned int num_threads) const {
+  const std::size_t num_bins = static_cast<std::size_t>(_nx) * _ny;
+  const std::size_t num_metrics = _metrics.size();
+  const std::size_t num_slots = _slots.size();
+
+  // histogram of every slot, then counts[s][b] becomes the first position of
+  // the samples of slot s in bin b, so bins are contiguous in slot order
+  std::vector<std::vector<std::size_t>> counts(num_slots);
+  parallel_for(
+      num_slots,
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        for (std::size_t s = begin_idx; s < end_idx; ++s) {
+          counts[s].assign(num_bins, 0);
+          for (std::uint32_t bin : _slots[s].bins) {
+            ++counts[s][bin];
+          }
+        }
+      },
+      num_threads);
+  std::vector<std::size_t> offsets(num_bins + 1, 0);
+  std::size_t pos = 0;
+  for (std::size_t b = 0; b < num_bins; ++b) {
+    offsets[b] = pos;
+    for (auto &count : counts) {
+      std::size_t k = count[b];
+      count[b] = pos;
+      pos += k;
+    }
+  }
+  offsets[num_bins] = pos;
+
+  std::vector<double> values(pos * num_metrics);
+  parallel_for(
+      num_slots,
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        for (std::size_t s = begin_idx; s < end_idx; ++s) {
+          const auto &slot = _slots[s];
+          for (std::size_t i = 0; i < slot.bins.size(); ++i) {
+            std::size_t to = counts[s][slot.bins[i]]++;
+            std::copy_n(slot.values.begin() + i * num_metrics, num_metrics,
+                        values.begin() + to * num_metrics);
+          }
+        }
+      },
+      num_threads);
+
+  // every bin is reduced by the thread owning it, rows are kept in bin order
+  std::vector<std::vector<std::string>> rows(num_bins);
+  parallel_for(
+      num_bins,
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        std::vector<double> sorted;
+        for (std::size_t b = begin_idx; b < end_idx; ++b) {
+          std::size_t n = offsets[b + 1] - offsets[b];
+          if (n == 0) {
+            continue;
+          }
+          int bx = static_cast<int>(b % _nx);
+          int by = static_cast<int>(b / _nx);
+          auto &row = rows[b];
+          row = {std::to_string(bx),
+                 std::to_string(by),
+                 fmt::format("{}", _die[0] + bx * _bin_w),
+                 fmt::format("{}", _die[1] + by * _bin_h),
+                 fmt::format("{}", _die[0] + (bx + 1) * _bin_w),
+                 fmt::format("{}", _die[1] + (by + 1) * _bin_h),
+                 std::to_string(n)};
+          for (std::size_t m = 0; m < num_metrics; ++m) {
+            sorted.clear();
+            for (std::size_t i = offsets[b]; i < offsets[b + 1]; ++i) {
+              double value = values[i * num_metrics + m];
+              if (!std::isnan(value)) {
+                sorted.push_back(value);
+              }
+            }
+            row.push_back(std::to_string(sorted.size()));
+            if (sorted.empty()) {
+              row.insert(row.end(), 2 + percentiles.size(), "");
+              continue;
+            }
+            std::sort(sorted.begin(), sorted.end());
+            double sum = 0.;
+            for (double value : sorted) {
+              sum += value;
+            }
+            row.push_back(fmt::format("{}", sum / sorted.size()));
+            row.push_back(fmt::format("{}", sorted.back()));
+            for (double p : percentiles) {
+              double rank =
+                  std::clamp(p, 0., 100.) / 100. * (sorted.size() - 1);
+              std::size_t lo = static_cast<std::size_t>(rank);
+              std::size_t hi = std::min(lo + 1, sorted.size() - 1);
+              row.push_back(fmt::format(
+                  "{}", sorted[lo] + (rank - lo) * (sorted[hi] - sorted[lo])));
+            }
+          }
+        }
+      },
+      num_threads);
+
+  std::vector<std::string> headers = {"x",   "y",   "llx",  "lly",
+                                      "urx", "ury", "count"};
+  for (const auto &metric : _metrics) {
+    headers.push_back(fmt::format("{}_count", metric));
+    headers.push_back(fmt::format("{}_mean", metric));
+    headers.push_back(fmt::format("{}_max", metric));
+    for (double p : percentiles) {
+      headers.push_back(fmt::format("{}_p{}", metric, p));
+    }
+  }
+  csv_writer out(filename, headers);
+  out.set_output_dir(output_dir);
+  std::size_t num_rows = 0;
+  for (const auto &row : rows) {
+    if (!row.empty()) {
+      out.add_row(row);
+      ++num_rows;
+    }
+  }
+  out.write();
+  fmt::print("Wrote {} samples in {} of {}x{} bins to {}\n", pos, num_rows,
+             _nx, _ny, filename);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "dm/spatial_grid.h"
+#include "utils/parallel.h"
+
+// heatmap bins per-arc metrics (delta_delay, delta_slack, ...) into a
+// uniform grid over the die by pin location. Every worker appends to its
+// own slot, write() groups the samples by bin and reduces each bin to
+// count, mean, max and percentiles, one csv row per non-empty bin.
+class heatmap {
+ public:
+  heatmap(const spatial_grid::window &die, int nx, int ny,
+          std::vector<std::string> metrics, unsigned int num_slots);
+
+  // values[m] belongs to metrics[m], NaN for a missing value; a slot must
+  // only be filled by one thread at a time
+  void add(unsigned int slot, const std::pair<double, double> &loc,
+           std::span<const double> values);
+  std::size_t size() const;
+
+  // percentiles in [0, 100], linear between the closest ranks
+  void write(const std::string &filename, const std::string &output_dir,
+             const std::vector<double> &percentiles,
+             unsigned int num_threads = default_num_threads()) const;
+
+ private:
+  struct samples {
+    std::vector<std::uint32_t> bins;
+    std::vector<double> values;  // metrics.size() values per bin entry
+  };
+
+  spatial_grid::window _die;
+  int _nx;
+  int _ny;
+  double _bin_w;
+  double _bin_h;
+  std::vector<std::string> _metrics;
+  std::vector<samples> _slots;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// number of worker threads used by the parallel helpers below
+inline unsigned int default_num_threads() {
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Split [0, n) into contiguous chunks and run func(t, begin, end) for every
+// chunk on its own thread. Runs inline when only one chunk is needed.
+template <typename Func>
+void parallel_for(std::size_t n, Func &&func,
+                  unsigned int num_threads = default_num_threads()) {
+  if (n == 0) {
+    return;
+  }
+  num_threads = static_cast<unsigned int>(
+      std::max<std::size_t>(1, std::min<std::size_t>(num_threads, n)));
+  if (num_threads == 1) {
+    func(0u, std::size_t{0}, n);
+    return;
+  }
+  const std::size_t chunk_size = (n + num_threads - 1) / num_threads;
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads);
+  for (unsigned int t = 0; t < num_threads; ++t) {
+    std::size_t begin_idx = t * chunk_size;
+    std::size_t end_idx = std::min(begin_idx + chunk_size, n);
+    if (begin_idx >= n) break;
+    threads.emplace_back(
+        [&func, t, begin_idx, end_idx]() { func(t, begin_idx, end_idx); });
+  }
+  for (auto &th : threads) {
+    if (th.joinable()) {
+      th.join();
+    }
+  }
+}
+
+// Run func(t, i) for every i in [0, n). Threads take the next index from a
+// shared counter, so tasks of uneven size balance out; pass the largest tasks
+// first to keep the tail short.
+template <typename Func>
+void parallel_for_dynamic(std::size_t n, Func &&func,
+                          unsigned int num_threads = default_num_threads()) {
+  std::atomic<std::size_t> next = 0;
+  parallel_for(
+      std::min<std::size_t>(n, num_threads),
+      [&](unsigned int t, std::size_t, std::size_t) {
+        for (std::size_t i = next++; i < n; i = next++) {
+          func(t, i);
+        }
+      },
+      num_threads);
+}
@@ -1,350 +1,1011 @@
 #include "utils/sparse_graph_shortest_path.h"
 
+#include <fmt/color.h>
 #include <fmt/core.h>
 
+#include <atomic>
+#include <bit>
+#include <boost/iostreams/device/mapped_file.hpp>
+#include <chrono>
 #include <cstdint>
-#include <queue>
-#include <thread>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <ranges>
+#include <type_traits>
 
+#include "utils/parallel.h"
 #include "utils/scoped_timer.h"
 
-int sparse_graph_shortest_path::get_or_create_node_id(
-    const std::string_view &node_name) {
-  auto it = _string_to_int.find(node_name);
-  if (it != _string_to_int.end()) {
-    return it->second;
-  }
-  int node_id = _next_node_id++;
-  // _string_to_int[node_name] = node_id;
-  _string_to_int.emplace(node_name, node_id);
-  _int_to_string.emplace_back(node_name);
-  return node_id;
+namespace {
+// CSR of (from, to, delay) triples grouped by from, edges keep input order
+void build_csr(std::size_t num_nodes, const std::vector<int> &from,
+               const std::vector<int> &to,
+               const std::vector<sparse_graph_shortest_path::weights> &delay,
+               std::vector<std::size_t> &offsets,
+               std::vector<sparse_graph_shortest_path::edge> &edges) {
+  offsets.assign(num_nodes + 1, 0);
+  for (int u : from) {
+    ++offsets[u + 1];
+  }
+  for (std::size_t u = 0; u < num_nodes; ++u) {
+    offsets[u + 1] += offsets[u];
+  }
+  std::vector<std::size_t> next(offsets.begin(), offsets.end() - 1);
+  edges.resize(from.size());
+  for (std::size_t e = 0; e < from.size(); ++e) {
+    edges[next[from[e]]++] = {to[e], static_cast<int>(e), delay[e]};
+  }
+}
+
+// FNV-1a, unlike absl::Hash it is the same in every run
+constexpr std::uint64_t fnv_basis = 14695981039346656037ull;
+std::uint64_t fnv1a(std::uint64_t hash, const void *data, std::size_t size) {
+  const auto *bytes = static_cast<const unsigned char *>(data);
+  for (std::size_t i = 0; i < size; ++i) {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
 }
 
+// hash of the pins and delays of the arcs in order, chunks are hashed in
+// parallel and then chained, the chunk size is fixed so the key does not
+// depend on the threads
+std::uint64_t arcs_key(
+    const std::vector<std::shared_ptr<Arc>> &edges,
+    const std::function<sparse_graph_shortest_path::weights(
+        const std::shared_ptr<Arc> &)> &delay_extractor) {
+  constexpr std::size_t chunk = 1 << 16;
+  std::vector<std::uint64_t> chunk_keys((edges.size() + chunk - 1) / chunk);
+  parallel_for(chunk_keys.size(), [&](unsigned int, std::size_t begin_idx,
+                                      std::size_t end_idx) {
+    for (std::size_t c = begin_idx; c < end_idx; ++c) {
+      std::uint64_t hash = fnv_basis;
+      const std::size_t end = std::min(edges.size(), (c + 1) * chunk);
+      for (std::size_t e = c * chunk; e < end; ++e) {
+        const auto &arc = *edges[e];
+        hash = fnv1a(hash, arc.from_pin.data(), arc.from_pin.size() + 1);
+        hash = fnv1a(hash, arc.to_pin.data(), arc.to_pin.size() + 1);
+        auto delay = delay_extractor(edges[e]);
+        hash = fnv1a(hash, delay.data(), sizeof(delay));
+      }
+      chunk_keys[c] = hash;
+    }
+  });
+  std::size_t num_edges = edges.size();
+  std::uint64_t key = fnv1a(fnv_basis, &num_edges, sizeof(num_edges));
+  return fnv1a(key, chunk_keys.data(), chunk_keys.size() * sizeof(key));
+}
+
+namespace image {
+constexpr std::array<char, 8> file_magic = {'S', 'L', 'K', 'G',
+                                            'R', 'A', 'P', 'H'};
+constexpr uint32_t version = 3;
+
+enum section_id : uint32_t {
+  NameOffsets,  // uint64_t offsets into the blob, num nodes + 1
+  NameBlob,     // char
+  FwdOffsets,
+  FwdEdges,
+  RevOffsets,
+  RevEdges,
+  ComponentBegin,
+  SccFirst,
+  Labels,
+  NumSections,
+};
+
+struct section {
+  uint64_t offset;
+  uint64_t count;
+};
+
+struct file_header {
+  std::array<char, 8> magic;
+  uint32_t version;
+  uint32_t num_sections;
+  uint64_t key;
+  uint64_t num_arcs;  // edges index the arcs below this
+  std::array<section, NumSections> sections;
+};
+
+// the records of a section, empty and ok cleared if it lies outside the file
+template <typename T>
+std::span<const T> get(const char *data, std::size_t size,
+                       const file_header &header, section_id id, bool &ok) {
+  static_assert(std::is_trivially_copyable_v<T>);
+  const auto &sec = header.sections[id];
+  if (!ok || sec.offset % alignof(T) != 0 || sec.offset > size ||
+      sec.count > (size - sec.offset) / sizeof(T)) {
+    ok = false;
+    return {};
+  }
+  return {reinterpret_cast<const T *>(data + sec.offset), sec.count};
+}
+}  // namespace image
+}  // namespace
+
 std::string_view sparse_graph_shortest_path::get_node_name(int node_id) const {
-  if (node_id >= 0 && node_id < static_cast<int>(_int_to_string.size())) {
-    return _int_to_string[node_id];
+  if (node_id >= 0 && node_id < static_cast<int>(_names.size())) {
+    return _names[node_id];
   }
   return "";
 }
 
 int sparse_graph_shortest_path::get_node_id(
     const std::string_view &node_name) const {
-  auto it = _string_to_int.find(node_name);
-  return (it != _string_to_int.end()) ? it->second : -1;
+  auto it = _ids.find(node_name);
+  return (it != _ids.end()) ? it->second : -1;
 }
 
 void sparse_graph_shortest_path::build_graph(
     const std::vector<std::shared_ptr<Arc>> &edges) {
   build_graph_base(edges, [](const std::shared_ptr<Arc> &edge) {
-    if constexpr (dm::TARGET_DLY_USING_MAX) {
-      return std::max(edge->delay[0], edge->delay[1]);
-    } else {
-      return std::min(edge->delay[0], edge->delay[1]);
-    }
+    double delay = dm::TARGET_DLY_USING_MAX
+                       ? std::max(edge->delay[0], edge->delay[1])
+                       : std::min(edge->delay[0], edge->delay[1]);
+    return weights{delay, delay};
   });
 }
 
 void sparse_graph_shortest_path::build_graph_base(
     const std::vector<std::shared_ptr<Arc>> &edges,
-    std::function<double(const std::shared_ptr<Arc> &)> delay_extractor) {
-  for (const auto &edge : edges) {
-    int from_id = get_or_create_node_id(edge->from_pin);
-    int to_id = get_or_create_node_id(edge->to_pin);
-    double target_delay = delay_extractor(edge);
-    _adj_list[from_id].emplace_back(to_id, target_delay);
-    _rev_adj_list[to_id].emplace_back(from_id, target_delay);
-    _all_nodes.insert(from_id);
-    _all_nodes.insert(to_id);
-  }
-  _component_id.resize(_all_nodes.size(), 0);
-  {
-    scoped_timer timer(timing_stats, "compute_components_check");
-    compute_components();
+    std::function<weights(const std::shared_ptr<Arc> &)> delay_extractor) {
+  std::string image_path;
+  std::uint64_t key = 0;
+  if (!_image_dir.empty()) {
+    {
+      scoped_timer timer(timing_stats, "image_key");
+      key = arcs_key(edges, delay_extractor);
+    }
+    image_path = fmt::format("{}/{:016x}.graph", _image_dir, key);
+    scoped_timer timer(timing_stats, "load_image");
+    if (load_image(image_path, key, edges.size())) {
+      fmt::print("Loaded graph image {}\n", image_path);
+      return;
+    }
   }
+  _image.reset();
+
+  // temporary ids in order of appearance
+  std::vector<std::string_view> names;
+  absl::flat_hash_map<std::string_view, int> ids;
+  std::vector<int> from(edges.size());
+  std::vector<int> to(edges.size());
+  std::vector<weights> delay(edges.size());
+  std::vector<std::size_t> offsets, rev_offsets;
+  std::vector<edge> fwd, rev;
   {
-    scoped_timer timer(timing_stats, "topo_sort");
-
-    const int num_threads = 1;
-    std::vector<std::thread> threads;
-    threads.reserve(num_threads);
-
-    // Calculate work distribution
-    const int work_per_thread = _components_computed / num_threads;
-    const int remainder = _components_computed % num_threads;
-
-    int start_idx = 0;
-    for (int t = 0; t < num_threads; ++t) {
-      // Distribute remainder work among first few threads
-      int end_idx = start_idx + work_per_thread + (t < remainder ? 1 : 0);
-
-      // Launch thread for this work chunk
-      threads.emplace_back([start_idx, end_idx, this]() {
-        for (int i = start_idx; i < end_idx; ++i) {
-          // fmt::print("start comp {}, total comp {}\n", i, components_computed);
-          topological_sort(i);
-        }
-      });
-
-      start_idx = end_idx;
-    }
-
-    // Wait for all threads to complete
-    for (auto &thread : threads) {
-      if (thread.joinable()) {
-        thread.join();
+    scoped_timer timer(timing_stats, "build_csr");
+    ids.reserve(edges.size());
+    auto intern = [&](std::string_view name) {
+      auto [it, inserted] = ids.try_emplace(name, names.size());
+      if (inserted) {
+        names.push_back(name);
       }
+      return it->second;
+    };
+    for (std::size_t e = 0; e < edges.size(); ++e) {
+      from[e] = intern(edges[e]->from_pin);
+      to[e] = intern(edges[e]->to_pin);
+      delay[e] = delay_extractor(edges[e]);
     }
+    build_csr(names.size(), from, to, delay, offsets, fwd);
+    build_csr(names.size(), to, from, delay, rev_offsets, rev);
   }
-}
 
-void sparse_graph_shortest_path::compute_components() {
-  if (_components_computed != 0) return;
-  // std::unordered_set<int> visited;
-  std::vector<int8_t> visited(_all_nodes.size(), 0);
-  int comp_id = 0;
-  for (int node_id : _all_nodes) {
-    if (visited[node_id] == 0) {
-      _graph_components.resize(comp_id + 1);
-      std::queue<int> q;
-      q.push(node_id);
-      visited[node_id] = 1;
-      _component_id[node_id] = comp_id;
-      _graph_components[comp_id].push_back(node_id);
-      while (!q.empty()) {
-        int curr = q.front();
-        q.pop();
-        if (_adj_list.find(curr) != _adj_list.end()) {
-          for (const auto &[neighbor_id, _] : _adj_list[curr]) {
-            if (visited[neighbor_id] == 0) {
-              visited[neighbor_id] = 1;
-              _component_id[neighbor_id] = comp_id;
-              _graph_components[comp_id].push_back(neighbor_id);
-              q.push(neighbor_id);
-            }
-          }
-        }
-        if (_rev_adj_list.find(curr) != _rev_adj_list.end()) {
-          for (const auto &[neighbor_id, _] : _rev_adj_list[curr]) {
-            if (visited[neighbor_id] == 0) {
-              visited[neighbor_id] = 1;
-              _component_id[neighbor_id] = comp_id;
-              _graph_components[comp_id].push_back(neighbor_id);
-              q.push(neighbor_id);
-            }
-          }
-        }
+  std::vector<int> order = order_nodes(offsets, fwd, rev_offsets);
+
+  {
+    scoped_timer timer(timing_stats, "renumber");
+    const std::size_t n = order.size();
+    std::vector<int> new_id(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      new_id[order[i]] = static_cast<int>(i);
+    }
+    _names.resize(n);
+    _ids.clear();
+    _ids.reserve(n);
+    _fwd_offsets.assign(n + 1, 0);
+    _rev_offsets.assign(n + 1, 0);
+    _fwd_edges.clear();
+    _fwd_edges.reserve(fwd.size());
+    _rev_edges.clear();
+    _rev_edges.reserve(rev.size());
+    for (std::size_t i = 0; i < n; ++i) {
+      int old = order[i];
+      _names[i] = names[old];
+      _ids.emplace(names[old], static_cast<int>(i));
+      for (std::size_t e = offsets[old]; e < offsets[old + 1]; ++e) {
+        _fwd_edges.push_back({new_id[fwd[e].to], fwd[e].arc, fwd[e].delay});
       }
-      comp_id++;
+      for (std::size_t e = rev_offsets[old]; e < rev_offsets[old + 1]; ++e) {
+        _rev_edges.push_back({new_id[rev[e].to], rev[e].arc, rev[e].delay});
+      }
+      _fwd_offsets[i + 1] = _fwd_edges.size();
+      _rev_offsets[i + 1] = _rev_edges.size();
+    }
+    _component_id.resize(n);
+    for (std::size_t c = 0; c + 1 < _component_begin.size(); ++c) {
+      std::fill(_component_id.begin() + _component_begin[c],
+                _component_id.begin() + _component_begin[c + 1],
+                static_cast<int>(c));
     }
   }
-  _components_computed = comp_id;
-  _graph_sizes.reserve(_components_computed);
-  _topological_orders.resize(_components_computed);
-  for (const auto &nodes : _graph_components) {
-    _graph_sizes.push_back(nodes.size());
+
+  {
+    scoped_timer timer(timing_stats, "reach_labels");
+    build_reach_labels();
   }
-  for (int i = 0; i < _components_computed; ++i) {
-    _topological_orders[i].reserve(_graph_sizes[i]);
+
+  if (!image_path.empty()) {
+    scoped_timer timer(timing_stats, "write_image");
+    if (write_image(image_path, key, edges.size())) {
+      fmt::print("Wrote graph image {}\n", image_path);
+    }
   }
 }
 
-void sparse_graph_shortest_path::topological_sort(int comp_id) {
-  std::unique_lock lock(_component_mutex);
-  const auto nodes = std::move(_graph_components[comp_id]);
-  lock.unlock();
-  const size_t node_count = nodes.size();
-
-  // Early exit for trivial cases
-  if (node_count <= 1) {
-    return;
+bool sparse_graph_shortest_path::write_image(const std::string &image_path,
+                                             std::uint64_t key,
+                                             std::size_t num_arcs) const {
+  std::vector<uint64_t> name_offsets = {0};
+  name_offsets.reserve(num_nodes() + 1);
+  std::string name_blob;
+  for (auto name : _names) {
+    name_blob.append(name);
+    name_offsets.push_back(name_blob.size());
   }
 
-  // Otherwise, reserve space for better performance
-  std::unordered_map<int, int> in_degree;
-  in_degree.reserve(node_count);
+  std::error_code ec;
+  std::filesystem::create_directories(
+      std::filesystem::path(image_path).parent_path(), ec);
+  // write next to the target and rename, a reader never sees a partial file
+  std::string tmp_path = image_path + ".tmp";
+  std::ofstream ofs(tmp_path, std::ios::binary);
+  if (!ofs) {
+    fmt::print(fmt::fg(fmt::color::red), "Cannot open graph image {}\n",
+               tmp_path);
+    return false;
+  }
+  image::file_header header{};
+  header.magic = image::file_magic;
+  header.version = image::version;
+  header.num_sections = image::NumSections;
+  header.key = key;
+  header.num_arcs = num_arcs;
+  ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  auto put = [&](image::section_id id, const auto &records) {
+    using T = std::ranges::range_value_t<decltype(records)>;
+    static_assert(std::is_trivially_copyable_v<T>);
+    static constexpr std::array<char, 8> padding{};
+    auto pos = static_cast<uint64_t>(ofs.tellp());
+    ofs.write(padding.data(), (8 - pos % 8) % 8);
+    header.sections[id] = {.offset = static_cast<uint64_t>(ofs.tellp()),
+                           .count = records.size()};
+    ofs.write(reinterpret_cast<const char *>(records.data()),
+              records.size() * sizeof(T));
+  };
+  put(image::NameOffsets, name_offsets);
+  put(image::NameBlob, name_blob);
+  put(image::FwdOffsets, _fwd_offsets);
+  put(image::FwdEdges, _fwd_edges);
+  put(image::RevOffsets, _rev_offsets);
+  put(image::RevEdges, _rev_edges);
+  put(image::ComponentBegin, _component_begin);
+  put(image::SccFirst, _scc_first);
+  put(image::Labels, _labels);
+  ofs.seekp(0);
+  ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  ofs.close();
+  if (!ofs) {
+    fmt::print(fmt::fg(fmt::color::red), "Cannot write graph image {}\n",
+               tmp_path);
+    return false;
+  }
+  std::filesystem::rename(tmp_path, image_path, ec);
+  if (ec) {
+    fmt::print(fmt::fg(fmt::color::red), "Cannot move graph image to {}, {}\n",
+               image_path, ec.message());
+    return false;
+  }
+  return true;
+}
 
-  // Initialize in-degrees
-  for (int node : nodes) {
-    in_degree[node] = 0;
+bool sparse_graph_shortest_path::load_image(const std::string &image_path,
+                                            std::uint64_t key,
+                                            std::size_t num_arcs) {
+  if (!std::filesystem::exists(image_path)) {
+    return false;
+  }
+  auto file = std::make_shared<boost::iostreams::mapped_file_source>();
+  try {
+    file->open(image_path);
+  } catch (const std::exception &err) {
+    fmt::print(fmt::fg(fmt::color::red), "Cannot map graph image {}, {}\n",
+               image_path, err.what());
+    return false;
+  }
+  const char *data = file->data();
+  const std::size_t size = file->size();
+  image::file_header header{};
+  if (size < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, data, sizeof(header));
+  bool ok = header.magic == image::file_magic &&
+            header.version == image::version &&
+            header.num_sections == image::NumSections && header.key == key &&
+            header.num_arcs == num_arcs;
+  using image::get;
+  auto name_offsets = get<uint64_t>(data, size, header, image::NameOffsets, ok);
+  auto name_blob = get<char>(data, size, header, image::NameBlob, ok);
+  auto fwd_offsets =
+      get<std::size_t>(data, size, header, image::FwdOffsets, ok);
+  auto fwd_edges = get<edge>(data, size, header, image::FwdEdges, ok);
+  auto rev_offsets =
+      get<std::size_t>(data, size, header, image::RevOffsets, ok);
+  auto rev_edges = get<edge>(data, size, header, image::RevEdges, ok);
+  auto component_begin =
+      get<int>(data, size, header, image::ComponentBegin, ok);
+  auto scc_first = get<int>(data, size, header, image::SccFirst, ok);
+  auto labels = get<std::array<interval, _num_labels>>(data, size, header,
+                                                       image::Labels, ok);
+  const std::size_t n = scc_first.size();
+  auto valid_csr = [&](auto offsets, auto edges) {
+    return offsets.size() == n + 1 && offsets.front() == 0 &&
+           offsets.back() == edges.size() && std::ranges::is_sorted(offsets) &&
+           std::ranges::all_of(edges, [&](const edge &e) {
+             return e.to >= 0 && static_cast<std::size_t>(e.to) < n &&
+                    e.arc >= 0 && static_cast<std::size_t>(e.arc) < num_arcs;
+           });
+  };
+  ok = ok && name_offsets.size() == n + 1 &&
+       name_offsets.back() <= name_blob.size() &&
+       std::ranges::is_sorted(name_offsets) &&
+       valid_csr(fwd_offsets, fwd_edges) && valid_csr(rev_offsets, rev_edges) &&
+       !component_begin.empty() && component_begin.front() == 0 &&
+       component_begin.back() == static_cast<int>(n) &&
+       std::ranges::is_sorted(component_begin) && labels.size() == n &&
+       std::ranges::all_of(scc_first, [&](int first) {
+         return first >= 0 && static_cast<std::size_t>(first) < n;
+       });
+  if (!ok) {
+    fmt::print(fmt::fg(fmt::color::red),
+               "Graph image {} is damaged or of other arcs, rebuild\n",
+               image_path);
+    return false;
   }
 
-  // Calculate in-degrees
-  for (int node : nodes) {
-    auto it = _adj_list.find(node);
-    if (it != _adj_list.end()) {
-      for (const auto &neighbor : it->second) {
-        in_degree[neighbor.first]++;
-      }
-    }
+  _names.resize(n);
+  _ids.clear();
+  _ids.reserve(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    _names[i] = {name_blob.data() + name_offsets[i],
+                 name_offsets[i + 1] - name_offsets[i]};
+    _ids.emplace(_names[i], static_cast<int>(i));
+  }
+  _fwd_offsets.assign(fwd_offsets.begin(), fwd_offsets.end());
+  _fwd_edges.assign(fwd_edges.begin(), fwd_edges.end());
+  _rev_offsets.assign(rev_offsets.begin(), rev_offsets.end());
+  _rev_edges.assign(rev_edges.begin(), rev_edges.end());
+  _component_begin.assign(component_begin.begin(), component_begin.end());
+  _scc_first.assign(scc_first.begin(), scc_first.end());
+  _labels.assign(labels.begin(), labels.end());
+  _component_id.resize(n);
+  for (std::size_t c = 0; c + 1 < _component_begin.size(); ++c) {
+    std::fill(_component_id.begin() + _component_begin[c],
+              _component_id.begin() + _component_begin[c + 1],
+              static_cast<int>(c));
   }
+  _image = std::move(file);
+  return true;
+}
 
-  // Use vector as queue for better cache performance
-  std::vector<int> queue;
-  queue.reserve(node_count);
-  std::vector<int> result;
-  result.reserve(node_count);
+void sparse_graph_shortest_path::build_reach_labels() {
+  constexpr int unvisited = -1;
+  constexpr int on_stack = -2;
+  _labels.assign(num_nodes(), {});
+  for (auto &labels : _labels) {
+    labels.fill({std::numeric_limits<int>::max(), unvisited});
+  }
+  // a strongly connected component is one dag node labelled at its first
+  // node, its out-edges are the contiguous edges of its nodes. Label l of
+  // component c is task c * _num_labels + l; odd labels visit roots and
+  // children in reverse, so the two post-orders differ
+  struct frame {
+    int scc;
+    std::size_t begin;  // edge range of the nodes of scc
+    std::size_t end;
+    std::size_t next;
+  };
+  parallel_for(
+      (_component_begin.size() - 1) * _num_labels,
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        std::vector<frame> stack;
+        for (std::size_t task = begin_idx; task < end_idx; ++task) {
+          const std::size_t c = task / _num_labels;
+          const int l = static_cast<int>(task % _num_labels);
+          const bool reversed = l % 2 == 1;
+          const int begin = _component_begin[c];
+          const int end = _component_begin[c + 1];
+          auto push = [&](int scc) {
+            _labels[scc][l].post = on_stack;
+            stack.push_back({scc, _fwd_offsets[scc],
+                             _fwd_offsets[scc_end(scc)], 0});
+          };
+          int post = 0;
+          for (int i = begin; i < end; ++i) {
+            int root = reversed ? end - 1 - (i - begin) : i;
+            if (_scc_first[root] != root ||
+                _labels[root][l].post != unvisited) {
+              continue;
+            }
+            push(root);
+            while (!stack.empty()) {
+              auto &top = stack.back();
+              const int u = top.scc;
+              if (top.next < top.end - top.begin) {
+                std::size_t e = reversed ? top.end - 1 - top.next
+                                         : top.begin + top.next;
+                ++top.next;
+                int v = _scc_first[_fwd_edges[e].to];
+                if (v == u) {
+                  continue;  // inside the component
+                }
+                if (_labels[v][l].post == unvisited) {
+                  push(v);
+                } else {
+                  // a dag, so v is finished
+                  _labels[u][l].low =
+                      std::min(_labels[u][l].low, _labels[v][l].low);
+                }
+                continue;
+              }
+              auto &label = _labels[u][l];
+              label.post = post++;
+              label.low = std::min(label.low, label.post);
+              stack.pop_back();
+              if (!stack.empty()) {
+                auto &parent = _labels[stack.back().scc][l];
+                parent.low = std::min(parent.low, label.low);
+              }
+            }
+          }
+        }
+      });
+}
 
-  // Find all nodes with in-degree 0
-  for (const auto &[node, degree] : in_degree) {
-    if (degree == 0) {
-      queue.push_back(node);
+std::vector<int> sparse_graph_shortest_path::order_nodes(
+    const std::vector<std::size_t> &offsets, const std::vector<edge> &edges,
+    const std::vector<std::size_t> &rev_offsets) {
+  const std::size_t n = offsets.size() - 1;
+  const unsigned int num_threads = default_num_threads();
+
+  // weakly connected components by a lock free union find over the edges,
+  // a larger root is always linked below a smaller one, so the root of a
+  // component is its smallest node
+  std::vector<int> parent(n);
+  std::vector<int> comp_nodes(n);
+  {
+    scoped_timer timer(timing_stats, "components");
+    for (std::size_t v = 0; v < n; ++v) {
+      parent[v] = static_cast<int>(v);
+    }
+    auto find = [&](int v) {
+      for (int p; (p = std::atomic_ref(parent[v]).load()) != v;) {
+        v = p;
+      }
+      return v;
+    };
+    parallel_for(
+        n,
+        [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+          for (std::size_t u = begin_idx; u < end_idx; ++u) {
+            for (std::size_t e = offsets[u]; e < offsets[u + 1]; ++e) {
+              int a = find(static_cast<int>(u));
+              int b = find(edges[e].to);
+              while (a != b) {
+                if (a < b) {
+                  std::swap(a, b);
+                }
+                if (std::atomic_ref(parent[a]).compare_exchange_weak(a, b)) {
+                  break;
+                }
+                a = find(a);
+                b = find(b);
+              }
+            }
+          }
+        },
+        num_threads);
+    parallel_for(
+        n,
+        [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+          for (std::size_t v = begin_idx; v < end_idx; ++v) {
+            std::atomic_ref(parent[v]).store(find(static_cast<int>(v)));
+          }
+        },
+        num_threads);
+
+    // components numbered by their smallest node, every component is a
+    // contiguous range of comp_nodes in node order
+    std::vector<int> comp_of_root(n, -1);
+    _component_begin.clear();
+    for (std::size_t v = 0; v < n; ++v) {
+      if (parent[v] == static_cast<int>(v)) {
+        comp_of_root[v] = static_cast<int>(_component_begin.size());
+        _component_begin.push_back(0);
+      }
+    }
+    _component_begin.push_back(0);
+    for (std::size_t v = 0; v < n; ++v) {
+      ++_component_begin[comp_of_root[parent[v]] + 1];
+    }
+    for (std::size_t c = 1; c < _component_begin.size(); ++c) {
+      _component_begin[c] += _component_begin[c - 1];
+    }
+    std::vector<int> next(_component_begin.begin(),
+                          _component_begin.end() - 1);
+    for (std::size_t v = 0; v < n; ++v) {
+      comp_nodes[next[comp_of_root[parent[v]]]++] = static_cast<int>(v);
     }
   }
-
-  size_t queue_pos = 0;
-
-  // Process nodes
-  while (queue_pos < queue.size()) {
-    int u = queue[queue_pos++];
-    result.push_back(u);
-
-    auto it = _adj_list.find(u);
-    if (it != _adj_list.end()) {
-      for (const auto &neighbor : it->second) {
-        int v = neighbor.first;
-        if (--in_degree[v] == 0) {
-          queue.push_back(v);
+  const std::size_t num_comps = _component_begin.size() - 1;
+
+  scoped_timer timer(timing_stats, "topo_sort");
+  // Kahn per component, the order of a component is written over its own
+  // range, nodes on or behind a cycle are left for condense
+  std::vector<int> in_degree(n);
+  for (std::size_t v = 0; v < n; ++v) {
+    in_degree[v] = static_cast<int>(rev_offsets[v + 1] - rev_offsets[v]);
+  }
+  std::vector<int> order(n);
+  _scc_first.resize(n);
+
+  // the nodes Kahn left only have edges among themselves. Tarjan finds
+  // their strongly connected components sinks first, so they are written
+  // from the end of the component back to the sorted part
+  std::vector<int> index(n, -1);
+  std::vector<int> low(n);
+  auto condense = [&](std::size_t c, int pos) {
+    const int begin = _component_begin[c];
+    const int end = _component_begin[c + 1];
+    for (int i = begin; i < pos; ++i) {
+      _scc_first[i] = i;
+    }
+    if (pos == end) {
+      return;
+    }
+    constexpr int done = std::numeric_limits<int>::max();
+    std::vector<int> stack;
+    std::vector<std::pair<int, std::size_t>> calls;  // node, next edge
+    int counter = 0;
+    int write = end;
+    auto visit = [&](int v) {
+      index[v] = low[v] = counter++;
+      stack.push_back(v);
+      calls.emplace_back(v, offsets[v]);
+    };
+    for (int i = begin; i < end; ++i) {
+      int root = comp_nodes[i];
+      if (in_degree[root] == 0 || index[root] != -1) {
+        continue;
+      }
+      visit(root);
+      while (!calls.empty()) {
+        auto &[u, e] = calls.back();
+        if (e < offsets[u + 1]) {
+          int v = edges[e++].to;
+          if (index[v] == -1) {
+            visit(v);
+          } else {
+            // a finished component has index done and changes nothing
+            low[u] = std::min(low[u], index[v]);
+          }
+          continue;
+        }
+        const int finished = u;
+        calls.pop_back();
+        if (!calls.empty()) {
+          int caller = calls.back().first;
+          low[caller] = std::min(low[caller], low[finished]);
+        }
+        if (low[finished] != index[finished]) {
+          continue;
         }
+        const int scc_end = write;
+        int v;
+        do {
+          v = stack.back();
+          stack.pop_back();
+          index[v] = done;
+          order[--write] = v;
+        } while (v != finished);
+        std::fill(_scc_first.begin() + write, _scc_first.begin() + scc_end,
+                  write);
       }
     }
+  };
+
+  // largest first, components worth more than a thread are sorted one
+  // after the other by all threads, the rest go one per task to the pool
+  std::vector<int> by_size(num_comps);
+  for (std::size_t c = 0; c < num_comps; ++c) {
+    by_size[c] = static_cast<int>(c);
+  }
+  auto comp_size = [&](int c) {
+    return _component_begin[c + 1] - _component_begin[c];
+  };
+  std::stable_sort(by_size.begin(), by_size.end(),
+                   [&](int a, int b) { return comp_size(a) > comp_size(b); });
+  const std::size_t giant_size =
+      std::max<std::size_t>(1 << 14, n / num_threads);
+  std::size_t num_giants = 0;
+  while (num_giants < num_comps &&
+         static_cast<std::size_t>(comp_size(by_size[num_giants])) >=
+             giant_size) {
+    ++num_giants;
   }
 
-  // Update the component with sorted result
-  lock.lock();
-  _graph_components[comp_id] = std::move(result);
-  for (size_t i = 0; i < _graph_components[comp_id].size(); ++i) {
-    int node = _graph_components[comp_id][i];
-    _topological_orders[comp_id][node] = i;
+  // level synchronous Kahn, a level is expanded in parallel and the next
+  // level is sorted by id so the order does not depend on the threads
+  std::vector<std::vector<int>> found(num_threads);
+  for (std::size_t g = 0; g < num_giants; ++g) {
+    const std::size_t c = by_size[g];
+    const int begin = _component_begin[c];
+    int pos = begin;
+    for (int i = begin; i < _component_begin[c + 1]; ++i) {
+      if (in_degree[comp_nodes[i]] == 0) {
+        order[pos++] = comp_nodes[i];
+      }
+    }
+    for (int level = begin; level < pos;) {
+      const std::size_t width = pos - level;
+      parallel_for(
+          width,
+          [&](unsigned int t, std::size_t begin_idx, std::size_t end_idx) {
+            for (std::size_t i = begin_idx; i < end_idx; ++i) {
+              int u = order[level + i];
+              for (std::size_t e = offsets[u]; e < offsets[u + 1]; ++e) {
+                if (std::atomic_ref(in_degree[edges[e].to]).fetch_sub(1) ==
+                    1) {
+                  found[t].push_back(edges[e].to);
+                }
+              }
+            }
+          },
+          width < 1024 ? 1 : num_threads);
+      const int level_end = pos;
+      for (auto &nodes : found) {
+        std::copy(nodes.begin(), nodes.end(), order.begin() + pos);
+        pos += static_cast<int>(nodes.size());
+        nodes.clear();
+      }
+      std::sort(order.begin() + level_end, order.begin() + pos);
+      level = level_end;
+    }
+    condense(c, pos);
   }
+
+  parallel_for_dynamic(
+      num_comps - num_giants,
+      [&](unsigned int, std::size_t task) {
+        const std::size_t c = by_size[num_giants + task];
+        const int begin = _component_begin[c];
+        int pos = begin;
+        for (int i = begin; i < _component_begin[c + 1]; ++i) {
+          if (in_degree[comp_nodes[i]] == 0) {
+            order[pos++] = comp_nodes[i];
+          }
+        }
+        for (int head = begin; head < pos; ++head) {
+          int u = order[head];
+          for (std::size_t e = offsets[u]; e < offsets[u + 1]; ++e) {
+            if (--in_degree[edges[e].to] == 0) {
+              order[pos++] = edges[e].to;
+            }
+          }
+        }
+        condense(c, pos);
+      },
+      num_threads);
+  return order;
 }
 
 cache_result sparse_graph_shortest_path::query_shortest_distance(
-    const std::string_view &from, const std::string_view &to) {
+    const std::string_view &from, const std::string_view &to,
+    int transition) {
+  auto start = std::chrono::steady_clock::now();
   int from_id = get_node_id(from);
   int to_id = get_node_id(to);
   if (from_id == -1 || to_id == -1) {
-    return {-1, {}};
+    return {};
   }
-  return query_shortest_distance_by_id(from_id, to_id);
+  cache_result result =
+      query_shortest_distance_by_id(from_id, to_id, transition);
+  _query_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+  ++_num_queries;
+  return result;
 }
 
-cache_result sparse_graph_shortest_path::query_shortest_distance_by_id(
-    int from_id, int to_id) {
-  cache_result result;
-  if (_all_nodes.find(from_id) == _all_nodes.end()) {
-    fmt::print(stderr, "Debug: from_id {} does not exist in all_nodes\n",
-               from_id);
-    return {-1, {}};
-  }
-  if (_all_nodes.find(to_id) == _all_nodes.end()) {
-    fmt::print(stderr, "Debug: to_id {} does not exist in all_nodes\n", to_id);
-    return {-1, {}};
-  }
-  if (from_id == to_id) {
-    return {0, {get_node_name(from_id)}};
-  }
-  {
-    // scoped_timer timer(timing_stats, "check_connectivity");
-    if (_component_id.at(from_id) != _component_id.at(to_id)) {
-      fmt::print(stderr,
-                 "Debug: from_id {} and to_id {} are in different components\n",
-                 from_id, to_id);
-      return {-1, {}};
+std::vector<std::array<cache_result, 2>>
+sparse_graph_shortest_path::query_shortest_distances(
+    std::span<const std::string_view> froms, std::string_view to) {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::array<cache_result, 2>> results(froms.size());
+  const int to_id = get_node_id(to);
+  // sources that cannot reach `to` are answered here and left out
+  std::vector<int> from_ids(froms.size(), -1);
+  int lo = to_id;
+  if (to_id != -1) {
+    for (std::size_t i = 0; i < froms.size(); ++i) {
+      int from_id = get_node_id(froms[i]);
+      if (from_id != -1 && (from_id == to_id || may_reach(from_id, to_id))) {
+        from_ids[i] = from_id;
+        lo = std::min(lo, reach_bound(from_id));
+      }
     }
   }
-  {
-    // scoped_timer timer(timing_stats, "dijkstra_call");
-    result = dijkstra_topo(from_id, to_id, _component_id.at(from_id));
+  if (to_id != -1) {
+    scratch &s = local_scratch();
+    const std::size_t allocations = s.allocations;
+    // with a negative cycle on the cone no source has a shortest path
+    const bool settled = sweep_cone(to_id, lo, s);
+    for (std::size_t i = 0; settled && i < froms.size(); ++i) {
+      int from_id = from_ids[i];
+      if (from_id == -1) {
+        continue;
+      }
+      if (from_id == to_id) {
+        results[i].fill({0, {from_id}, {}});
+      } else if (s.reached(from_id)) {
+        for (int k : {0, 1}) {
+          results[i][k] = reconstruct_path(from_id, to_id, s, k);
+        }
+      }
+    }
+    _scratch_allocations += s.allocations - allocations;
   }
-  return result;
+  _query_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now() - start)
+                   .count();
+  _num_queries += froms.size();
+  return results;
 }
 
-cache_result sparse_graph_shortest_path::dijkstra_topo(int from_id, int to_id,
-                                                       int comp_id) const {
-  using namespace std;
-  // 优先队列：pair<distance, node>
-  priority_queue<pair<double, int>, vector<pair<double, int>>,
-                 greater<pair<double, int>>>
-      pq;
-
-  // int n_nodes = graph_sizes.at(comp_id);
-  unordered_map<int, double> dist;
-  unordered_map<int, int> parent;
-  unordered_map<int, bool> visited;
-
-  constexpr int bucket_size = 64;
-  parent.reserve(bucket_size);
-  dist.reserve(bucket_size);
-  visited.reserve(bucket_size);
-
-  dist[to_id] = 0.0;
-  pq.push({0.0, to_id});
-
-  int from_id_pos = _topological_orders.at(comp_id).at(from_id);
-
-  while (!pq.empty()) {
-    auto [d, u] = pq.top();
-    pq.pop();
+sparse_graph_shortest_path::scratch &
+sparse_graph_shortest_path::local_scratch() {
+  thread_local scratch s;
+  return s;
+}
 
-    if (visited.find(u) != visited.end() || visited[u]) continue;
-    visited[u] = true;
+void sparse_graph_shortest_path::scratch::begin(std::size_t num_nodes) {
+  if (stamp.size() < num_nodes) {
+    dist.resize(num_nodes);
+    parent.resize(num_nodes);
+    stamp.resize(num_nodes, 0);
+    allocations += 3;
+  }
+  heap.clear();
+  if (++epoch == 0) {
+    // the stamps wrapped around, none of them may look current
+    std::fill(stamp.begin(), stamp.end(), 0);
+    epoch = 1;
+  }
+}
 
-    // 找到目标
-    if (u == from_id) {
-      return reconstruct_path(from_id, to_id, parent, d);
+bool sparse_graph_shortest_path::sweep_cone(int to_id, int lo,
+                                            scratch &s) const {
+  // every in-edge of a node comes from a smaller id or from its own strongly
+  // connected component, so popping the largest reached id first settles a
+  // node, or a whole component, after all its successors
+  auto larger_id = [](const auto &a, const auto &b) {
+    return a.second < b.second;
+  };
+  auto relax = [&](int u, const edge &e) {
+    const int v = e.to;
+    bool improved = false;
+    for (int k : {0, 1}) {
+      if (double new_dist = s.dist[u][k] + e.delay[k];
+          new_dist < s.dist[v][k]) {
+        s.dist[v][k] = new_dist;
+        s.parent[v][k] = {u, e.arc};
+        improved = true;
+      }
     }
-
-    // 拓扑序剪枝：只扩展位置在from_id之后的节点
-    if (_topological_orders.at(comp_id).at(u) < from_id_pos) continue;
-
-    // 遍历出边
-    if (_rev_adj_list.find(u) != _rev_adj_list.end()) {
-      for (const auto &[v, w] : _rev_adj_list.at(u)) {
-        // 只考虑拓扑序小于等于to_id的节点
-        if (_topological_orders.at(comp_id).at(v) < from_id_pos) continue;
-
-        double new_dist = d + w;
-        if (dist.find(v) == dist.end() || new_dist < dist[v]) {
-          dist[v] = new_dist;
-          parent[v] = u;
-          pq.push({new_dist, v});
+    return improved;
+  };
+  s.begin(num_nodes());
+  s.reach(to_id);
+  s.dist[to_id] = {0.0, 0.0};
+  s.push({0.0, to_id}, larger_id);
+  while (!s.heap.empty()) {
+    int u = s.pop(larger_id).second;
+    const int first = _scc_first[u];
+    const int end = scc_end(u);
+    if (end - first > 1) {
+      // the rest of the component reached from outside is next on the heap,
+      // a label correcting search over its inner edges settles them all
+      const std::size_t capacity = s.queue.capacity();
+      s.queue.assign(1, u);
+      while (!s.heap.empty() && s.heap.front().second >= first) {
+        s.queue.push_back(s.pop(larger_id).second);
+      }
+      // the queue is worked in passes, pass p settles the shortest paths
+      // with p inner edges, so a change after as many passes as the
+      // component has nodes can only come from a negative cycle
+      std::size_t pass_end = s.queue.size();
+      int passes = 0;
+      for (std::size_t head = 0; head < s.queue.size(); ++head) {
+        if (head == pass_end) {
+          pass_end = s.queue.size();
+          if (++passes >= end - first) {
+            fmt::print(fmt::fg(fmt::color::red),
+                       "Negative cycle through {} towards {}\n",
+                       get_node_name(s.queue[head]), get_node_name(to_id));
+            s.allocations += s.queue.capacity() != capacity;
+            return false;
+          }
+        }
+        int x = s.queue[head];
+        for (const auto &e : in_edges(x)) {
+          const int v = e.to;
+          if (v < std::max(first, lo) || v >= end) continue;
+          bool reached = s.reached(v);
+          if (!reached) {
+            s.reach(v);
+          }
+          if (relax(x, e) || !reached) {
+            s.queue.push_back(v);
+          }
         }
       }
+      s.allocations += s.queue.capacity() != capacity;
+    }
+    for (int x = std::max(first, lo); x < end; ++x) {
+      if (!s.reached(x)) continue;
+      for (const auto &e : in_edges(x)) {
+        const int v = e.to;
+        if (v < lo || v >= first) continue;
+        if (!s.reached(v)) {
+          s.reach(v);
+          s.push({0.0, v}, larger_id);
+        }
+        relax(x, e);
+      }
     }
   }
+  return true;
+}
 
-  return cache_result(-1, {});  // 不可达
+bool sparse_graph_shortest_path::may_reach(int from_id, int to_id) const {
+  const int comp = _component_id[to_id];
+  if (_component_id[from_id] != comp) {
+    ++_rejected[0];
+    return false;
+  }
+  const int from_scc = _scc_first[from_id];
+  const int to_scc = _scc_first[to_id];
+  if (from_scc == to_scc) {
+    return true;  // one cycle
+  }
+  // strongly connected components only reach components placed after them
+  if (from_scc > to_scc) {
+    ++_rejected[1];
+    return false;
+  }
+  for (int l = 0; l < _num_labels; ++l) {
+    const auto &from = _labels[from_scc][l];
+    const auto &to = _labels[to_scc][l];
+    if (to.low < from.low || to.post > from.post) {
+      ++_rejected[2];
+      return false;
+    }
+  }
+  return true;
+}
+
+cache_result sparse_graph_shortest_path::query_shortest_distance_by_id(
+    int from_id, int to_id, int transition) const {
+  if (from_id == to_id) {
+    return {0, {from_id}, {}};
+  }
+  if (!may_reach(from_id, to_id)) {
+    return {};
+  }
+  return cone_path(from_id, to_id, transition);
+}
+
+cache_result sparse_graph_shortest_path::cone_path(int from_id, int to_id,
+                                                   int transition) const {
+  // the same sweep as the batch query, so both agree on every pair and a
+  // negative cycle is reported instead of searched forever
+  scratch &s = local_scratch();
+  const std::size_t allocations = s.allocations;
+  cache_result result;  // 不可达
+  if (sweep_cone(to_id, reach_bound(from_id), s) && s.reached(from_id)) {
+    result = reconstruct_path(from_id, to_id, s, transition);
+  }
+  _scratch_allocations += s.allocations - allocations;
+  return result;
 }
 
 cache_result sparse_graph_shortest_path::reconstruct_path(
-    int from_id, int to_id, const std::unordered_map<int, int> &previous,
-    double distance) const {
-  cache_result cache_result(distance, {});
-  if (to_id == from_id) {
-    cache_result.path = {get_node_name(from_id)};
-    return cache_result;
-  }
-  std::vector<std::string_view> path;
+    int from_id, int to_id, const scratch &s, int transition) const {
+  cache_result cache_result(s.dist[from_id][transition], {from_id}, {});
   int current = from_id;
-  while (current != to_id && previous.find(current) != previous.end()) {
-    path.push_back(get_node_name(current));
-    current = previous.at(current);
+  while (current != to_id && current != -1) {
+    const auto &[next, arc] = s.parent[current][transition];
+    if (next != -1) {
+      cache_result.nodes.push_back(next);
+      cache_result.arcs.push_back(arc);
+    }
+    current = next;
   }
-  if (current == to_id) {
-    path.push_back(get_node_name(to_id));
-    // std::reverse(path.begin(), path.end());
-    cache_result.path = path;
+  if (current != to_id) {
+    cache_result.nodes.clear();
+    cache_result.arcs.clear();
   }
   return cache_result;
 }
 
+std::size_t sparse_graph_shortest_path::memory_bytes() const {
+  return _names.capacity() * sizeof(std::string_view) +
+         _ids.capacity() * (sizeof(std::pair<std::string_view, int>) + 1) +
+         (_fwd_offsets.capacity() + _rev_offsets.capacity()) *
+             sizeof(std::size_t) +
+         (_fwd_edges.capacity() + _rev_edges.capacity()) * sizeof(edge) +
+         (_component_id.capacity() + _component_begin.capacity() +
+          _scc_first.capacity()) *
+             sizeof(int) +
+         _labels.capacity() * sizeof(_labels[0]);
+}
+
 void sparse_graph_shortest_path::print_stats() const {
-  int edge_count = 0;
-  for (const auto &[node_id, neighbors] : _adj_list) {
-    edge_count += neighbors.size();
+  // strongly connected components of more than one node by log2 of size
+  std::size_t num_sccs = 0;
+  std::size_t cyclic_nodes = 0;
+  std::size_t largest = 1;
+  std::vector<std::size_t> cyclic_by_size;
+  for (int first = 0; first < static_cast<int>(num_nodes());) {
+    std::size_t size = scc_end(first) - first;
+    ++num_sccs;
+    if (size > 1) {
+      cyclic_nodes += size;
+      largest = std::max(largest, size);
+      std::size_t bucket = std::bit_width(size) - 2;
+      cyclic_by_size.resize(std::max(cyclic_by_size.size(), bucket + 1));
+      ++cyclic_by_size[bucket];
+    }
+    first += static_cast<int>(size);
+  }
+  fmt::print("Number of nodes: {}\n", num_nodes());
+  fmt::print("Number of edges: {}\n", num_edges());
+  fmt::print("Number of components: {}\n", _component_begin.size() - 1);
+  fmt::print(
+      "Strongly connected components: {}, {} nodes on cycles, largest {}\n",
+      num_sccs, cyclic_nodes, largest);
+  for (std::size_t b = 0; b < cyclic_by_size.size(); ++b) {
+    if (cyclic_by_size[b] > 0) {
+      fmt::print("  cycles of {}-{} nodes: {}\n", std::size_t{2} << b,
+                 (std::size_t{4} << b) - 1, cyclic_by_size[b]);
+    }
+  }
+  fmt::print("Graph memory: {:.2f} MB\n", memory_bytes() / 1048576.);
+  for (const auto &[name, time] : timing_stats) {
+    fmt::print("Timing stats {}: {} s\n", name, time / 1e6);
+  }
+  if (std::size_t queries = _num_queries.load(); queries > 0) {
+    fmt::print("Queries: {}, {:.2f} us on average\n", queries,
+               _query_ns.load() / 1e3 / queries);
+    fmt::print("Search scratch allocations: {}\n",
+               _scratch_allocations.load());
+    fmt::print(
+        "Rejected queries: {} by component, {} by topological order, {} by "
+        "reach labels\n",
+        _rejected[0].load(), _rejected[1].load(), _rejected[2].load());
   }
-  fmt::print("Number of nodes: {}\n", _all_nodes.size());
-  fmt::print("Number of edges: {}\n", edge_count);
-  fmt::print("String to int mappings: {}\n", _string_to_int.size());
 }
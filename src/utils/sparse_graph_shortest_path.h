@@ -1,39 +1,75 @@
 #pragma once
 
+#include <absl/container/flat_hash_map.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <limits>
 #include <memory>
-#include <mutex>
+#include <span>
+#include <string>
 #include <string_view>
 #include <unordered_map>
-#include <unordered_set>
 #include <vector>
-#include <functional>
 
 #include "dm/dm.h"
 #include "utils/cache_result.h"
 
+// sparse_graph_shortest_path answers pin to pin shortest delay queries on
+// the arc graph of a db. Nodes are renumbered in (component, topological)
+// order of the strongly connected components, so a component and every
+// cycle in it are contiguous id ranges and edges only lead to larger ids or
+// stay inside a cycle; edges are kept as forward / reverse CSR.
 class sparse_graph_shortest_path {
  public:
   // 构造函数
   sparse_graph_shortest_path(){};
+  virtual ~sparse_graph_shortest_path() = default;
 
   // 构建图的邻接表
   virtual void build_graph(const std::vector<std::shared_ptr<Arc>> &edges);
 
-  // 查询两点间最短距离 (string接口)
+  // directory of graph images: build_graph maps the image of the same arcs
+  // and delays if there is one, and writes one after building otherwise
+  void set_image_dir(std::string dir) { _image_dir = std::move(dir); }
+
+  // an edge carries a rise and a fall delay, graphs built from one delay
+  // per arc keep it in both
+  using weights = std::array<double, 2>;
+
+  // 查询两点间最短距离 (string接口), transition 0 is rise, 1 is fall
   cache_result query_shortest_distance(const std::string_view &from,
-                                       const std::string_view &to);
+                                       const std::string_view &to,
+                                       int transition = 0);
+
+  // rise and fall shortest distances from every pin of froms to `to`,
+  // answered by one sweep over the backward cone of `to` in reverse
+  // topological order; result i belongs to froms[i]
+  std::vector<std::array<cache_result, 2>> query_shortest_distances(
+      std::span<const std::string_view> froms, std::string_view to);
 
-  // 获取图的统计信息
+  // 获取图的统计信息, query latency once queries ran
   void print_stats() const;
 
+  // pin name of a node id of a query result
+  std::string_view node_name(int node_id) const {
+    return get_node_name(node_id);
+  }
+
+  struct edge {
+    int to;   // the from node in the reverse CSR
+    int arc;  // position of the arc in the arcs the graph was built from
+    weights delay;
+  };
+
  protected:
   // 通用构建图逻辑
   void build_graph_base(
       const std::vector<std::shared_ptr<Arc>> &edges,
-      std::function<double(const std::shared_ptr<Arc> &)> delay_extractor);
-
-  // 获取或创建节点的int映射
-  int get_or_create_node_id(const std::string_view &node_name);
+      std::function<weights(const std::shared_ptr<Arc> &)> delay_extractor);
 
   // 根据int获取string
   std::string_view get_node_name(int node_id) const;
@@ -41,46 +77,146 @@ class sparse_graph_shortest_path {
   // 根据string获取int (如果不存在返回-1)
   int get_node_id(const std::string_view &node_name) const;
 
-  // 计算连通分量（用于快速判断两点是否连通）
-  void compute_components();
-
-  void topological_sort(int comp_id);
+  std::size_t num_nodes() const { return _names.size(); }
+  std::size_t num_edges() const { return _fwd_edges.size(); }
+  std::span<const edge> out_edges(int node) const {
+    return {_fwd_edges.data() + _fwd_offsets[node],
+            _fwd_edges.data() + _fwd_offsets[node + 1]};
+  }
+  std::span<const edge> in_edges(int node) const {
+    return {_rev_edges.data() + _rev_offsets[node],
+            _rev_edges.data() + _rev_offsets[node + 1]};
+  }
+  // node cannot reach nodes before this id, the first node of its strongly
+  // connected component
+  int reach_bound(int node) const { return _scc_first[node]; }
+  // one past the last node of the strongly connected component of node
+  int scc_end(int node) const {
+    int end = node + 1;
+    while (end < static_cast<int>(num_nodes()) &&
+           _scc_first[end] == _scc_first[node]) {
+      ++end;
+    }
+    return end;
+  }
+  std::size_t memory_bytes() const;
+
+  // false only if from_id surely cannot reach to_id: other component,
+  // later topological position, or a reach label not nesting in the one
+  // of from_id; rejections are counted per filter
+  bool may_reach(int from_id, int to_id) const;
+
+  // search state of one thread, dense over node ids. A slot is valid only
+  // while its stamp equals epoch, so starting a search is one increment;
+  // the buffers only grow and are reused by every later search
+  struct scratch {
+    std::vector<weights> dist;
+    // next node towards the target and the arc leading there
+    struct hop {
+      int node;
+      int arc;
+    };
+    std::vector<std::array<hop, 2>> parent;
+    std::vector<std::uint32_t> stamp;
+    std::uint32_t epoch = 0;
+    std::vector<std::pair<double, int>> heap;
+    std::vector<int> queue;  // worklist inside a cycle
+    std::size_t allocations = 0;  // buffer growths so far
+
+    void begin(std::size_t num_nodes);
+    bool reached(int node) const { return stamp[node] == epoch; }
+    // first touch of a node in this search, no transition is set yet
+    void reach(int node) {
+      constexpr double inf = std::numeric_limits<double>::infinity();
+      stamp[node] = epoch;
+      dist[node] = {inf, inf};
+      parent[node] = {hop{-1, -1}, hop{-1, -1}};
+    }
+    template <typename Compare>
+    void push(std::pair<double, int> entry, Compare compare) {
+      std::size_t capacity = heap.capacity();
+      heap.push_back(entry);
+      std::push_heap(heap.begin(), heap.end(), compare);
+      allocations += heap.capacity() != capacity;
+    }
+    template <typename Compare>
+    std::pair<double, int> pop(Compare compare) {
+      std::pop_heap(heap.begin(), heap.end(), compare);
+      auto entry = heap.back();
+      heap.pop_back();
+      return entry;
+    }
+  };
+  // the scratch of the calling thread, shared by all graphs it queries
+  static scratch &local_scratch();
 
   // 查询两点间最短距离 (int接口)
-  cache_result query_shortest_distance_by_id(int from_id, int to_id);
-  cache_result dijkstra_topo(int from_id, int to_id, int comp_id) const;
-  cache_result reconstruct_path(int from_id, int to_id,
-                                const std::unordered_map<int, int> &parent,
-                                double distance) const;
+  cache_result query_shortest_distance_by_id(int from_id, int to_id,
+                                             int transition) const;
+  // one pair answered by sweep_cone down to the bound of from_id
+  cache_result cone_path(int from_id, int to_id, int transition) const;
+  // both transitions over the backward cone of to_id down to id lo into s,
+  // cycles on the cone are settled as a whole, false on a negative cycle
+  bool sweep_cone(int to_id, int lo, scratch &s) const;
+  cache_result reconstruct_path(int from_id, int to_id, const scratch &s,
+                                int transition) const;
 
  public:
   std::unordered_map<std::string, long long> timing_stats;
 
+ private:
+  // GRAIL style interval labels of the condensed dag, one dfs post-order
+  // per label, components and labels are built in parallel
+  void build_reach_labels();
+  // (component, topological) order of the nodes, built on temporary ids;
+  // components by a parallel union find, then components are sorted
+  // largest first, the biggest by a level parallel Kahn, and what is left
+  // on or behind cycles is condensed by Tarjan
+  std::vector<int> order_nodes(const std::vector<std::size_t> &offsets,
+                               const std::vector<edge> &edges,
+                               const std::vector<std::size_t> &rev_offsets);
+  // the image holds the CSR, the names and ids in their final order, the
+  // components and the reach labels; key is the hash of the arcs it was
+  // built from, an image of other arcs or another version is not loaded;
+  // every edge must index one of the num_arcs arcs
+  bool write_image(const std::string &image_path, std::uint64_t key,
+                   std::size_t num_arcs) const;
+  bool load_image(const std::string &image_path, std::uint64_t key,
+                  std::size_t num_arcs);
+
+  std::string _image_dir;
+  std::shared_ptr<const void> _image;  // mapped image _names point into
+
  protected:
-  // 邻接表存储图结构 (使用int作为节点ID)
-  std::unordered_map<int, std::vector<std::pair<int, double>>>
-      _adj_list;  // {node_id: [(neighbor_id, dist)]}
-  std::unordered_map<int, std::vector<std::pair<int, double>>>
-      _rev_adj_list;  // {node_id: [(neighbor_id, dist)]}
+  // String和int的双向映射, views into the arcs of the db
+  std::vector<std::string_view> _names;  // node id -> pin name
+  absl::flat_hash_map<std::string_view, int> _ids;
 
-  // 存储所有节点ID
-  std::unordered_set<int> _all_nodes;
+  std::vector<std::size_t> _fwd_offsets = {0};
+  std::vector<edge> _fwd_edges;  // grouped by from node
+  std::vector<std::size_t> _rev_offsets = {0};
+  std::vector<edge> _rev_edges;  // grouped by to node
 
   // 连通分量信息
-  std::vector<int> _component_id;  // node_id -> component_id
-  int _components_computed = 0;
-
-  // String和int的双向映射
-  std::unordered_map<std::string_view, int> _string_to_int;  // string -> int
-  std::vector<std::string_view> _int_to_string;              // int -> string
-  int _next_node_id = 0;
-
-  std::vector<std::vector<int>> _graph_components;
-  std::vector<std::unordered_map<int, int>> _topological_orders;
-  std::vector<int> _graph_sizes;
-
-  std::mutex _graph_mutex;  // Protects adj_list, rev_adj_list
-
-  // Node set and component info
-  std::mutex _component_mutex;  // Protects component-related state
+  std::vector<int> _component_id;     // node id -> component id
+  std::vector<int> _component_begin;  // component id -> first node, + end
+  // node id -> first node of its strongly connected component, the node
+  // itself unless it is on a cycle
+  std::vector<int> _scc_first;
+
+  // [low, post] of a component holds the labels of every component it
+  // reaches, low is the smallest post-order number below it; kept at the
+  // first node of each strongly connected component
+  struct interval {
+    int low;
+    int post;
+  };
+  static constexpr int _num_labels = 2;
+  std::vector<std::array<interval, _num_labels>> _labels;
+
+  mutable std::atomic<std::size_t> _num_queries = 0;
+  mutable std::atomic<long long> _query_ns = 0;
+  mutable std::atomic<std::size_t> _scratch_allocations = 0;
+  // queries rejected by component, topological order and reach labels
+  mutable std::array<std::atomic<std::size_t>, 3> _rejected = {};
 };
@@ -1,13 +1,11 @@
 #pragma once
 #include "utils/sparse_graph_shortest_path.h"
 
+// sparse_graph_shortest_path_rf keeps the rise and the fall delay of every
+// arc on one topology, a query answers both transitions of the to pin
 class sparse_graph_shortest_path_rf : public sparse_graph_shortest_path {
  public:
-  sparse_graph_shortest_path_rf(bool is_topin_rise)
-      : sparse_graph_shortest_path(), _is_topin_rise(is_topin_rise) {}
+  sparse_graph_shortest_path_rf() : sparse_graph_shortest_path() {}
 
   void build_graph(const std::vector<std::shared_ptr<Arc>> &edges) override;
-
- private:
-  bool _is_topin_rise;
 };
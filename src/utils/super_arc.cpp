@@ -13,6 +13,7 @@ nlohmann::json to_json(const std::shared_ptr<Path> path,
   bool match = true;
   double delay = 0;
   std::vector<std::pair<float, float>> locs;
+  std::optional<double> hpwl;  // summed over the nets driven inside the arc
   node["pins"] = nlohmann::json::array();
   for (const auto &value_pin :
        path->path |
@@ -34,6 +35,10 @@ nlohmann::json to_json(const std::shared_ptr<Path> path,
            })) {
     node["pins"].push_back(value_pin->to_json());
     locs.push_back(value_pin->location);
+    if (!value_pin->is_input && value_pin->name != std::get<2>(names) &&
+        value_pin->net.has_value() && value_pin->net.value()->hpwl) {
+      hpwl = hpwl.value_or(0.) + *value_pin->net.value()->hpwl;
+    }
     if (value_pin->name == std::get<0>(names) &&
         value_pin->rise_fall == std::get<1>(names)) {
       continue;
@@ -42,6 +47,9 @@ nlohmann::json to_json(const std::shared_ptr<Path> path,
   }
   node["delay"] = delay;
   node["length"] = manhattan_distance(locs);
+  if (hpwl.has_value()) {
+    node["hpwl"] = hpwl.value();
+  }
   node["endpoint"] = path->endpoint;
   node["slack"] = path->slack;
   return node;
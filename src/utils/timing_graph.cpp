@@ -0,0 +1,500 @@
+#include "utils/timing_graph.h"
+
+#include <fmt/color.h>
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <mutex>
+
+#include "utils/scoped_timer.h"
+
+namespace {
+constexpr double inf = std::numeric_limits<double>::infinity();
+
+// rise and fall value of an optional pair, or of the single value
+std::optional<std::array<double, 2>> rise_fall(
+    const std::optional<std::array<double, 2>> &values,
+    const std::optional<double> &value) {
+  if (values.has_value()) {
+    return values;
+  }
+  if (value.has_value()) {
+    return std::array<double, 2>{value.value(), value.value()};
+  }
+  return std::nullopt;
+}
+}  // namespace
+
+void timing_graph::levelize() {
+  const int n = static_cast<int>(num_nodes());
+  // a node is placed after every node of another cycle reaching it, so one
+  // pass in id order sees the final level of all its fan-in
+  _level.assign(n, 0);
+  int num_levels = n > 0 ? 1 : 0;
+  _broken_edges = 0;
+  for (int v = 0; v < n; ++v) {
+    for (const auto &[u, arc, w] : in_edges(v)) {
+      if (_scc_first[u] == _scc_first[v]) {
+        ++_broken_edges;
+        continue;
+      }
+      _level[v] = std::max(_level[v], _level[u] + 1);
+    }
+    num_levels = std::max(num_levels, _level[v] + 1);
+  }
+  _level_begin.assign(num_levels + 1, 0);
+  for (int v = 0; v < n; ++v) {
+    ++_level_begin[_level[v] + 1];
+  }
+  for (int l = 0; l < num_levels; ++l) {
+    _level_begin[l + 1] += _level_begin[l];
+  }
+  std::vector<int> next(_level_begin.begin(), _level_begin.end() - 1);
+  _level_nodes.resize(n);
+  for (int v = 0; v < n; ++v) {
+    _level_nodes[next[_level[v]]++] = v;
+  }
+}
+
+bool timing_graph::is_endpoint(int id) const {
+  for (const auto &[v, arc, w] : out_edges(id)) {
+    if (_scc_first[v] != _scc_first[id]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool timing_graph::update_arrival(int v) {
+  auto &t = _timing[v];
+  const weights max_at = t.max_at;
+  const weights min_at = t.min_at;
+  if (_level[v] == 0) {
+    auto it = _start_at.find(v);
+    t.max_at = t.min_at = it != _start_at.end() ? it->second : weights{0., 0.};
+  } else {
+    t.max_at = {-inf, -inf};
+    t.min_at = {inf, inf};
+    for (const auto &[u, arc, w] : in_edges(v)) {
+      if (_scc_first[u] == _scc_first[v]) continue;
+      for (int k : {0, 1}) {
+        t.max_at[k] = std::max(t.max_at[k], _timing[u].max_at[k] + w[k]);
+        t.min_at[k] = std::min(t.min_at[k], _timing[u].min_at[k] + w[k]);
+      }
+    }
+  }
+  return t.max_at != max_at || t.min_at != min_at;
+}
+
+bool timing_graph::update_required(int u) {
+  auto &t = _timing[u];
+  const weights required = t.required;
+  t.required = {inf, inf};
+  bool endpoint = true;
+  for (const auto &[v, arc, w] : out_edges(u)) {
+    if (_scc_first[u] == _scc_first[v]) continue;
+    endpoint = false;
+    for (int k : {0, 1}) {
+      t.required[k] = std::min(t.required[k], _timing[v].required[k] - w[k]);
+    }
+  }
+  if (endpoint) {
+    if (auto it = _end_seeds.find(u); it != _end_seeds.end()) {
+      const auto &seed = it->second;
+      const weights at = seed.at.value_or(t.max_at);
+      for (int k : {0, 1}) {
+        t.required[k] = at[k] + seed.slack[k];
+      }
+    }
+  }
+  return t.required != required;
+}
+
+template <typename Visit>
+void timing_graph::for_nodes(std::span<const int> nodes,
+                             unsigned int num_threads, Visit &&visit) const {
+  parallel_for(
+      nodes.size(),
+      [&](unsigned int t, std::size_t begin_idx, std::size_t end_idx) {
+        for (std::size_t i = begin_idx; i < end_idx; ++i) {
+          visit(t, nodes[i]);
+        }
+      },
+      // thin levels are not worth the threads
+      nodes.size() < 1024 ? 1 : num_threads);
+}
+
+void timing_graph::propagate(
+    const std::unordered_map<std::string, std::shared_ptr<Pin>> &pins,
+    unsigned int num_threads) {
+  {
+    scoped_timer timer(timing_stats, "levelize");
+    levelize();
+  }
+  const int num_levels = static_cast<int>(_level_begin.size()) - 1;
+  auto level_nodes = [&](int l) {
+    return std::span<const int>(_level_nodes.data() + _level_begin[l],
+                                _level_nodes.data() + _level_begin[l + 1]);
+  };
+
+  // seeds of the start and end points from their at csv rows
+  {
+    scoped_timer timer(timing_stats, "seeds");
+    _start_at.clear();
+    _end_seeds.clear();
+    std::mutex seeds_mutex;
+    std::atomic<std::size_t> endpoints = 0;
+    parallel_for(
+        num_nodes(),
+        [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+          std::vector<std::pair<int, weights>> start_at;
+          std::vector<std::pair<int, endpoint_seed>> end_seeds;
+          for (std::size_t i = begin_idx; i < end_idx; ++i) {
+            const int v = static_cast<int>(i);
+            const bool endpoint = is_endpoint(v);
+            endpoints += endpoint;
+            if (_level[v] != 0 && !endpoint) {
+              continue;
+            }
+            auto it = pins.find(std::string(get_node_name(v)));
+            if (it == pins.end()) {
+              continue;
+            }
+            const Pin &pin = *it->second;
+            auto at = rise_fall(pin.path_delays, pin.path_delay);
+            if (_level[v] == 0 && at.has_value()) {
+              start_at.emplace_back(v, at.value());
+            }
+            auto slack = rise_fall(pin.path_slacks, pin.path_slack);
+            if (endpoint && slack.has_value()) {
+              // required times are the golden tool's, so is the arrival
+              end_seeds.emplace_back(v, endpoint_seed{slack.value(), at});
+            }
+          }
+          std::lock_guard<std::mutex> lock(seeds_mutex);
+          _start_at.insert(start_at.begin(), start_at.end());
+          _end_seeds.insert(end_seeds.begin(), end_seeds.end());
+        });
+    _num_startpoints = num_levels > 0 ? level_nodes(0).size() : 0;
+    _num_endpoints = endpoints;
+  }
+
+  // arrival, every node pulls from its fan-in of the levels before
+  _timing.assign(num_nodes(), {{-inf, -inf}, {inf, inf}, {inf, inf}});
+  {
+    scoped_timer timer(timing_stats, "arrival");
+    for (int l = 0; l < num_levels; ++l) {
+      for_nodes(level_nodes(l), num_threads,
+                [&](unsigned int, int v) { update_arrival(v); });
+    }
+  }
+  // required, every node pulls from its fan-out of the levels after
+  {
+    scoped_timer timer(timing_stats, "required");
+    for (int l = num_levels - 1; l >= 0; --l) {
+      for_nodes(level_nodes(l), num_threads,
+                [&](unsigned int, int u) { update_required(u); });
+    }
+  }
+  _queued.assign(num_nodes(), 0);
+}
+
+timing_graph::update_result timing_graph::update_delays(
+    std::span<const delay_change> changes, unsigned int num_threads) {
+  update_result result;
+  if (_level_begin.empty() || _queued.size() != num_nodes()) {
+    fmt::print(fmt::fg(fmt::color::red),
+               "Cannot update delays of a graph not propagated yet\n");
+    return result;
+  }
+  const int num_levels = static_cast<int>(_level_begin.size()) - 1;
+  // dirty nodes by level, the bits of _queued keep a node from being
+  // queued twice for its arrival (1) or its required time (2)
+  std::vector<std::vector<int>> arrival_dirty(num_levels);
+  std::vector<std::vector<int>> required_dirty(num_levels);
+  auto enqueue_arrival = [&](int v) {
+    if ((_queued[v] & 1) == 0) {
+      _queued[v] |= 1;
+      arrival_dirty[_level[v]].push_back(v);
+    }
+  };
+  auto enqueue_required = [&](int v) {
+    if ((_queued[v] & 2) == 0) {
+      _queued[v] |= 2;
+      required_dirty[_level[v]].push_back(v);
+    }
+  };
+
+  for (const auto &change : changes) {
+    const int from_id = get_node_id(change.from_pin);
+    const int to_id = get_node_id(change.to_pin);
+    if (from_id == -1 || to_id == -1) {
+      ++result.unknown_arcs;
+      continue;
+    }
+    bool found = false;
+    for (std::size_t e = _fwd_offsets[from_id]; e < _fwd_offsets[from_id + 1];
+         ++e) {
+      if (_fwd_edges[e].to == to_id) {
+        _fwd_edges[e].delay = change.delay;
+        found = true;
+      }
+    }
+    for (std::size_t e = _rev_offsets[to_id]; e < _rev_offsets[to_id + 1];
+         ++e) {
+      if (_rev_edges[e].to == from_id) {
+        _rev_edges[e].delay = change.delay;
+      }
+    }
+    if (!found) {
+      ++result.unknown_arcs;
+      continue;
+    }
+    ++result.changed_arcs;
+    if (_scc_first[from_id] != _scc_first[to_id]) {
+      enqueue_arrival(to_id);
+      enqueue_required(from_id);
+    }
+  }
+
+  // a level is recomputed in parallel, the fan-out of the changed nodes is
+  // queued afterwards, so only the cone that really changes is visited
+  std::vector<std::vector<int>> changed(num_threads);
+  std::vector<std::vector<std::pair<int, weights>>> thread_endpoints(
+      num_threads);
+  for (int l = 0; l < num_levels; ++l) {
+    auto &nodes = arrival_dirty[l];
+    for_nodes(nodes, num_threads, [&](unsigned int t, int v) {
+      const weights slack_before = slack(v);
+      _queued[v] &= ~1;
+      if (update_arrival(v)) {
+        changed[t].push_back(v);
+        if (is_endpoint(v)) {
+          thread_endpoints[t].emplace_back(v, slack_before);
+        }
+      }
+    });
+    result.arrivals += nodes.size();
+    nodes = {};
+    for (auto &thread_changed : changed) {
+      for (int v : thread_changed) {
+        for (const auto &[x, arc, w] : out_edges(v)) {
+          if (_scc_first[x] != _scc_first[v]) {
+            enqueue_arrival(x);
+          }
+        }
+        // an endpoint without a golden arrival is required relative to its
+        // propagated one
+        if (auto it = _end_seeds.find(v);
+            it != _end_seeds.end() && !it->second.at.has_value()) {
+          enqueue_required(v);
+        }
+      }
+      thread_changed.clear();
+    }
+  }
+  for (const auto &endpoints : thread_endpoints) {
+    result.endpoints.insert(result.endpoints.end(), endpoints.begin(),
+                            endpoints.end());
+  }
+
+  for (int l = num_levels - 1; l >= 0; --l) {
+    auto &nodes = required_dirty[l];
+    for_nodes(nodes, num_threads, [&](unsigned int t, int u) {
+      _queued[u] &= ~2;
+      if (update_required(u)) {
+        changed[t].push_back(u);
+      }
+    });
+    result.requireds += nodes.size();
+    nodes = {};
+    for (auto &thread_changed : changed) {
+      for (int u : thread_changed) {
+        for (const auto &[x, arc, w] : in_edges(u)) {
+          if (_scc_first[x] != _scc_first[u]) {
+            enqueue_required(x);
+          }
+        }
+      }
+      thread_changed.clear();
+    }
+  }
+  return result;
+}
+
+timing_graph::weights timing_graph::slack(int id) const {
+  weights slack;
+  for (int k : {0, 1}) {
+    const auto &t = _timing[id];
+    slack[k] = std::isfinite(t.required[k]) && std::isfinite(t.max_at[k])
+                   ? t.required[k] - t.max_at[k]
+                   : std::numeric_limits<double>::quiet_NaN();
+  }
+  return slack;
+}
+
+std::vector<timing_graph::critical_path> timing_graph::worst_paths(
+    int endpoint, std::size_t max_paths) const {
+  // partial paths share their suffix towards the endpoint: entry i is its
+  // node, the entry after it, the arc between them and the delay from the
+  // node to the endpoint
+  struct entry {
+    int node;
+    int next;
+    int arc;
+    int transition;
+    double delay;
+  };
+  std::vector<entry> entries;
+  std::vector<std::pair<double, int>> heap;  // (slack, entry), worst on top
+  auto compare = [](const auto &a, const auto &b) { return a.first > b.first; };
+  auto push = [&](const entry &e) {
+    const auto &t = _timing[endpoint];
+    double at = _timing[e.node].max_at[e.transition] + e.delay;
+    heap.emplace_back(t.required[e.transition] - at,
+                      static_cast<int>(entries.size()));
+    entries.push_back(e);
+    std::push_heap(heap.begin(), heap.end(), compare);
+  };
+  for (int k : {0, 1}) {
+    const auto &t = _timing[endpoint];
+    if (std::isfinite(t.required[k]) && std::isfinite(t.max_at[k])) {
+      push({endpoint, -1, -1, k, 0.});
+    }
+  }
+
+  std::vector<critical_path> paths;
+  while (!heap.empty() && paths.size() < max_paths) {
+    std::pop_heap(heap.begin(), heap.end(), compare);
+    const auto [slack, idx] = heap.back();
+    heap.pop_back();
+    const entry e = entries[idx];
+    if (_level[e.node] == 0) {
+      critical_path path{e.transition, slack, {}, {}};
+      for (int i = idx; i != -1; i = entries[i].next) {
+        path.nodes.push_back(entries[i].node);
+        if (entries[i].next != -1) {
+          path.arcs.push_back(entries[i].arc);
+        }
+      }
+      paths.push_back(std::move(path));
+      continue;
+    }
+    for (const auto &[u, arc, w] : in_edges(e.node)) {
+      if (_scc_first[u] == _scc_first[e.node] ||
+          !std::isfinite(_timing[u].max_at[e.transition])) {
+        continue;
+      }
+      push({u, idx, arc, e.transition, e.delay + w[e.transition]});
+    }
+  }
+  return paths;
+}
+
+std::vector<std::shared_ptr<Path>> timing_graph::worst_paths(
+    const basedb &db, std::size_t max_paths, std::size_t paths_per_endpoint,
+    unsigned int num_threads) const {
+  const int n = static_cast<int>(num_nodes());
+  std::vector<std::pair<double, int>> endpoints;  // (worst slack, node)
+  for (int v = 0; v < n; ++v) {
+    if (!is_endpoint(v)) {
+      continue;
+    }
+    const weights s = slack(v);
+    double worst = std::min(std::isnan(s[0]) ? inf : s[0],
+                            std::isnan(s[1]) ? inf : s[1]);
+    if (std::isfinite(worst)) {
+      endpoints.emplace_back(worst, v);
+    }
+  }
+  // every endpoint holds a path of its worst slack, so an endpoint after the
+  // first max_paths cannot beat any of theirs
+  if (max_paths == 0) {
+    max_paths = std::numeric_limits<std::size_t>::max();
+  }
+  std::ranges::sort(endpoints);
+  if (endpoints.size() > max_paths) {
+    endpoints.resize(max_paths);
+  }
+  std::vector<std::vector<critical_path>> endpoint_paths(endpoints.size());
+  parallel_for_dynamic(
+      endpoints.size(),
+      [&](unsigned int, std::size_t i) {
+        endpoint_paths[i] = worst_paths(
+            endpoints[i].second, std::min(max_paths, paths_per_endpoint));
+      },
+      num_threads);
+  std::vector<const critical_path *> found;
+  for (const auto &paths : endpoint_paths) {
+    for (const auto &path : paths) {
+      found.push_back(&path);
+    }
+  }
+  std::ranges::stable_sort(found, {}, &critical_path::slack);
+  if (found.size() > max_paths) {
+    found.resize(max_paths);
+  }
+
+  std::vector<std::shared_ptr<Path>> paths(found.size());
+  parallel_for(
+      found.size(),
+      [&](unsigned int, std::size_t begin_idx, std::size_t end_idx) {
+        for (std::size_t i = begin_idx; i < end_idx; ++i) {
+          const critical_path &found_path = *found[i];
+          const int k = found_path.transition;
+          auto path = std::make_shared<Path>();
+          path->slack = found_path.slack;
+          double at = _timing[found_path.nodes.front()].max_at[k];
+          for (std::size_t j = 0; j < found_path.nodes.size(); ++j) {
+            const int v = found_path.nodes[j];
+            const auto name = get_node_name(v);
+            std::shared_ptr<Pin> pin;
+            if (auto it = db.pins.find(std::string(name));
+                it != db.pins.end()) {
+              pin = std::make_shared<Pin>(*it->second);
+            } else {
+              pin = std::make_shared<Pin>();
+              pin->name = name;
+            }
+            double incr = 0.;
+            pin->is_input = false;
+            if (j > 0) {
+              const int arc_id = found_path.arcs[j - 1];
+              const int from = found_path.nodes[j - 1];
+              for (const auto &[x, arc, w] : out_edges(from)) {
+                if (arc == arc_id) {
+                  incr = w[k];
+                  break;
+                }
+              }
+              // the sink of a net arc is a cell input
+              pin->is_input = db.arcs.arc(arc_id)->type == arc_type::NetArc;
+            }
+            at += incr;
+            pin->incr_delay = incr;
+            pin->path_delay = at;
+            pin->rise_fall = k == 0;
+            if (pin->transs.has_value()) {
+              pin->trans = pin->transs.value()[k];
+            }
+            path->path.push_back(std::move(pin));
+          }
+          path->startpoint = path->path.front()->name;
+          path->endpoint = path->path.back()->name;
+          paths[i] = std::move(path);
+        }
+      },
+      num_threads);
+  return paths;
+}
+
+void timing_graph::print_timing_stats() const {
+  fmt::print(
+      "Timing sweep: {} levels, {} startpoints, {} endpoints, {} edges "
+      "inside cycles broken\n",
+      _level_begin.empty() ? 0 : _level_begin.size() - 1, _num_startpoints,
+      _num_endpoints, _broken_edges);
+}
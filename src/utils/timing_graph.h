@@ -0,0 +1,116 @@
+#pragma once
+#include <absl/container/flat_hash_map.h>
+
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "utils/parallel.h"
+#include "utils/sparse_graph_shortest_path_rf.h"
+
+// timing_graph propagates arrival times over the whole arc graph, STA
+// style: max and min arrival of every pin and transition forward from the
+// startpoints, required times backward from the endpoints. Pins are swept
+// level by level, a level in parallel; edges inside a cycle are broken like
+// an STA tool breaks combinational loops.
+class timing_graph : public sparse_graph_shortest_path_rf {
+ public:
+  struct pin_timing {
+    weights max_at;    // rise, fall; -inf if no startpoint reaches the pin
+    weights min_at;    // +inf if no startpoint reaches the pin
+    weights required;  // +inf if the pin reaches no endpoint with a slack
+  };
+
+  // startpoints (no in-edge) arrive at the max_rise/fall_at of their row in
+  // pins, or at 0. Endpoints (no out-edge) are required at that arrival,
+  // or the propagated one, plus their max_rise/fall_slack
+  void propagate(
+      const std::unordered_map<std::string, std::shared_ptr<Pin>> &pins,
+      unsigned int num_threads = default_num_threads());
+
+  struct delay_change {
+    std::string_view from_pin;
+    std::string_view to_pin;
+    weights delay;  // rise, fall
+  };
+  struct update_result {
+    std::size_t changed_arcs = 0;
+    std::size_t unknown_arcs = 0;  // pins not in the graph
+    std::size_t arrivals = 0;      // pins whose arrival was recomputed
+    std::size_t requireds = 0;
+    // endpoints whose arrival changed, with their slack before
+    std::vector<std::pair<int, weights>> endpoints;
+  };
+  // set the delays of the arcs between the given pins and propagate only
+  // from them: arrivals level by level down their fan-out cone, required
+  // times up their fan-in cone, both stop where a value stays the same;
+  // nothing is changed before propagate
+  update_result update_delays(std::span<const delay_change> changes,
+                              unsigned int num_threads = default_num_threads());
+
+  std::size_t num_pins() const { return num_nodes(); }
+  std::string_view pin_name(int id) const { return get_node_name(id); }
+  int pin_id(std::string_view name) const { return get_node_id(name); }
+  const pin_timing &timing(int id) const { return _timing[id]; }
+  // required - max arrival, NaN where either is unknown
+  weights slack(int id) const;
+  bool is_endpoint(int id) const;
+
+  // one of the worst paths into an endpoint, node ids from the startpoint
+  // and the arc ids of its hops, as in cache_result
+  struct critical_path {
+    int transition;  // 0 rise, 1 fall
+    double slack;
+    std::vector<int> nodes;
+    std::vector<int> arcs;
+  };
+  // up to max_paths worst paths into the endpoint over both transitions,
+  // worst first. A best first search backward from the endpoint, keyed by
+  // the slack of the best completion: the max arrival of the pin reached
+  // plus the delay behind it, so every popped startpoint is the next worst
+  // path and the search stays proportional to the paths it emits
+  std::vector<critical_path> worst_paths(int endpoint,
+                                         std::size_t max_paths) const;
+  // the max_paths worst paths of the design (0 keeps all), at most
+  // paths_per_endpoint into each endpoint with a required time, as paths of
+  // the pins of db, the graph must be built from its arcs; endpoints are
+  // searched in parallel, only the max_paths ones of the worst slack can
+  // hold one
+  std::vector<std::shared_ptr<Path>> worst_paths(
+      const basedb &db, std::size_t max_paths, std::size_t paths_per_endpoint,
+      unsigned int num_threads = default_num_threads()) const;
+
+  void print_timing_stats() const;
+
+ private:
+  // levels of the condensed dag, level 0 are the startpoints
+  void levelize();
+  // recompute a pin from its fan-in / fan-out, true if it changed
+  bool update_arrival(int v);
+  bool update_required(int u);
+  // run visit(node) for the nodes, in parallel if there are enough
+  template <typename Visit>
+  void for_nodes(std::span<const int> nodes, unsigned int num_threads,
+                 Visit &&visit) const;
+
+  // what the at csv gives the startpoints and endpoints
+  struct endpoint_seed {
+    weights slack;
+    std::optional<weights> at;  // golden arrival, else the propagated one
+  };
+  absl::flat_hash_map<int, weights> _start_at;
+  absl::flat_hash_map<int, endpoint_seed> _end_seeds;
+
+  std::vector<int> _level;        // node -> level
+  std::vector<int> _level_begin;  // level -> first of its nodes, + end
+  std::vector<int> _level_nodes;
+  std::size_t _num_startpoints = 0;
+  std::size_t _num_endpoints = 0;
+  std::size_t _broken_edges = 0;  // edges inside a cycle
+  std::vector<pin_timing> _timing;
+  std::vector<char> _queued;  // nodes waiting in an update
+};
@@ -107,6 +107,10 @@ double standardDeviation(const std::vector<double> &arr, std::size_t n) {
   return std::sqrt(variance(arr, n));
 }
 
+std::string format_time(double value) {
+  return std::isfinite(value) ? fmt::format("{}", value) : "";
+}
+
 void run_function(const std::string &func_name, std::function<void()> func) {
   auto start_elapsed = std::chrono::high_resolution_clock::now();
   std::clock_t start_cpu = std::clock();
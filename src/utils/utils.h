@@ -16,6 +16,8 @@ std::vector<std::pair<std::size_t, std::string_view>> split_string_by_n_spaces(
 bool isgz(const std::string &filename);
 double variance(const std::vector<double> &arr, std::size_t n);
 double standardDeviation(const std::vector<double> &arr, std::size_t n);
+// a time for a csv cell, empty for an unknown (infinite or NaN) value
+std::string format_time(double value);
 
 // Usage: run_function("name", [](){ do_something(); });
 void run_function(const std::string &func_name, std::function<void()> func);